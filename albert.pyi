@@ -3,7 +3,7 @@
 .. https://www.sphinx-doc.org/en/master/usage/restructuredtext/basics.html
 
 ====================================================================================================
-Albert Python interface v5.0
+Albert Python interface v5.1
 ====================================================================================================
 
 To be a valid Python plugin a Python module has to contain at least the mandatory metadata fields
@@ -60,11 +60,32 @@ Optional metadata variables
 ``md_platforms`` : *List(str)*
     List of supported platforms. If empty all platforms are supported.
 
+``md_lazy_handler`` : *List(str)*
+    Opt-in lazy activation: ``["triggered", <handler id>, <default trigger>]``. If set, the module
+    is not executed on load. Instead a proxy handler with the given id and default trigger is
+    registered, and the module is executed and the ``Plugin`` class instantiated on the first
+    query routed to it. The plugin has to provide exactly this single ``GeneratorQueryHandler``
+    or ``RankedQueryHandler`` extension. An empty id refers to the plugin id, i.e. the id of
+    handlers mixed into the ``Plugin`` class. Fuzzy matching is not supported.
+
 
 ====================================================================================================
 Changelog
 ====================================================================================================
 
+- ``5.1``
+
+  - Add metadata field ``md_lazy_handler``.
+  - The ``Plugin`` class is instantiated on a worker thread, unless a Qt binding (PyQt, PySide) has
+    been imported.
+  - Optionally plugins run in subinterpreters having their own GIL (Python 3.12+). ``Item``
+    subclasses are not supported in this mode.
+  - Optionally ``Item`` subclasses are snapshot when returned by a handler.
+  - Add property ``QueryContext.cancellation``. Generators of cancelled queries are closed.
+  - ``GeneratorQueryHandler.items`` may be an async generator or a coroutine.
+  - Add static method ``StandardItem.many`` for bulk construction.
+  - The properties of ``QueryContext`` return the same objects for the duration of a handler call.
+
 - ``5.0``
 
   This change adopts the coroutine based query handler API and internationalized tokenization.
@@ -239,8 +260,9 @@ Changelog
 from abc import abstractmethod, ABC
 from enum import IntEnum
 from pathlib import Path
+import threading
 from typing import Any, Callable, List, overload, final
-from collections.abc import Generator
+from collections.abc import AsyncGenerator, Coroutine, Generator
 
 class Action:
     """
@@ -524,6 +546,13 @@ class Matcher:
 class Item(ABC):
     """
     `C++ Reference <https://albertlauncher.github.io/reference/classalbert_1_1Item.html>`_
+
+    Subclassing raises a ``TypeError`` if the plugin runs in a subinterpreter. Use
+    :class:`StandardItem` in this case.
+
+    If the user enabled item snapshots, the text, subtext, input action text and icon of
+    subclass instances are read once when a handler returns them. Items changing these afterwards
+    are not supported in this mode. :func:`actions` is always called on demand.
     """
 
     @abstractmethod
@@ -611,6 +640,22 @@ class StandardItem(Item):
                  ):
         ...
 
+    @staticmethod
+    def many(ids: List[str],
+             texts: List[str] | None = None,
+             subtexts: List[str] | None = None,
+             icon_factory: Callable[[], Icon] | List[Callable[[], Icon]] | None = None,
+             actions: List[Action] | List[List[Action]] | None = None,
+             input_action_texts: List[str] | None = None
+             ) -> List[StandardItem]:
+        """
+        Creates one item per element of **ids**.
+
+        Much faster than calling the constructor per item, e.g. to build large indexes. The lists
+        have to be of the same length. **icon_factory** and **actions** are either shared by all
+        items or lists having an element per item. Omitted columns default to empty.
+        """
+
     def id(self) -> str:
         ...
 
@@ -689,6 +734,20 @@ class QueryContext:
         Returns the usage scoring.
         """
 
+    @property
+    def cancellation(self) -> threading.Event:
+        """
+        Returns an event that is set when the query has been cancelled.
+
+        Cheaper than polling :attr:`isValid` and can be waited on, e.g. instead of ``time.sleep``
+        or as timeout of blocking IO. Stays the same object for the duration of a call to ``items``
+        or ``rankItems``. The generator returned by ``items`` is closed (``GeneratorExit`` is raised
+        at its ``yield``) when pulled after the query has been cancelled.
+
+        If enabled in the settings, handlers still running 100 ms after the cancellation are
+        interrupted by an asynchronous ``GeneratorExit``.
+        """
+
 
 class Extension(ABC):
     """
@@ -766,12 +825,18 @@ class GeneratorQueryHandler(QueryHandler):
     """
 
     @abstractmethod
-    def items(self, context: QueryContext) -> Generator[List[Item]]:
+    def items(self, context: QueryContext) -> Generator[List[Item]] | AsyncGenerator[List[Item]] | Coroutine[Any, Any, List[Item]]:
         """
         Yields batches of items for **context** lazily.
 
         The batch size is defined by the implementation.
 
+        May be an async generator (``async def`` yielding batches) or a coroutine (``async def``
+        returning a single batch). These run on an asyncio event loop shared by the plugins of the
+        interpreter. The GIL is released while they await, hence the waits of concurrent queries
+        overlap. Awaiting is cancelled (``asyncio.CancelledError``) when the query is cancelled.
+        Blocking calls stall all coroutines, use ``asyncio.to_thread`` for them.
+
         Note: Executed in a background thread.
         """
 
@@ -982,6 +1047,9 @@ def runTerminal(script: str):
 class PluginInstance(ABC):
     """
     `C++ Reference <https://albertlauncher.github.io/reference/classalbert_1_1PluginInstance.html>`_
+
+    The ``Plugin`` class is instantiated on a worker thread to keep the user interface responsive.
+    If a Qt binding has been imported at that point, it is instantiated on the main thread instead.
     """
 
     def id(self) -> str:
@@ -0,0 +1,136 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#include "asyncioloop.h"
+#include "subinterpreters.h"
+#include <albert/logging.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+namespace py = pybind11;
+using namespace py::literals;
+using namespace std::chrono;
+using namespace std;
+
+namespace {
+
+const auto CANCELLATION_CHECK_INTERVAL = 10ms;  // Without the GIL, latency of cancellations
+const double JOIN_TIMEOUT = 1.;                 // seconds
+
+struct Loop
+{
+    py::object loop;
+    py::object thread;
+    py::object await;  // Wraps awaitables in a coroutine, run_coroutine_threadsafe requires one
+};
+
+// Signalled by the done callback of a future
+struct Completion
+{
+    mutex mtx;
+    condition_variable cv;
+    bool done = false;
+};
+
+// The Python objects are released in stop()
+mutex loops_mutex;
+map<PyInterpreterState*, Loop> loops;
+
+Loop eventLoop()
+{
+    auto *interpreter = currentInterpreter();
+    {
+        lock_guard lock(loops_mutex);
+        if (auto it = loops.find(interpreter); it != loops.end())
+            return it->second;
+    }
+
+    // Created unlocked, Python may release the GIL
+    Loop loop;
+    loop.loop = py::module::import("asyncio").attr("new_event_loop")();
+    loop.thread = py::module::import("threading").attr("Thread")(
+        "target"_a=loop.loop.attr("run_forever"), "name"_a="albert-asyncio", "daemon"_a=true);
+    py::dict scope;
+    py::exec("async def await_(awaitable):\n    return await awaitable\n", scope);
+    loop.await = scope["await_"];
+
+    {
+        lock_guard lock(loops_mutex);
+        if (auto [it, inserted] = loops.try_emplace(interpreter, loop); !inserted)
+        {
+            loop.loop.attr("close")();  // Lost the race
+            return it->second;
+        }
+    }
+
+    loop.thread.attr("start")();
+    DEBG << "Started asyncio event loop.";
+    return loop;
+}
+
+}
+
+optional<py::object> AsyncioLoop::run(const py::object &awaitable,
+                                      const function<bool()> &cancelled)
+{
+    const auto loop = eventLoop();
+    const auto future = py::module::import("asyncio").attr("run_coroutine_threadsafe")(
+        loop.await(awaitable), loop.loop);
+
+    // Called on the loop thread, or right away if done already
+    auto completion = make_shared<Completion>();
+    future.attr("add_done_callback")(py::cpp_function([completion](const py::object &) {
+        {
+            lock_guard lock(completion->mtx);
+            completion->done = true;
+        }
+        completion->cv.notify_all();
+    }));
+
+    bool done;
+    {
+        py::gil_scoped_release release;
+        unique_lock lock(completion->mtx);
+        if (cancelled)  // Cheap C++ check, does not need the GIL
+            while (!completion->done && !cancelled())
+                completion->cv.wait_for(lock, CANCELLATION_CHECK_INTERVAL);
+        else
+            completion->cv.wait(lock, [&] { return completion->done; });
+        done = completion->done;
+    }
+
+    if (!done)
+    {
+        future.attr("cancel")();  // Raises CancelledError at the await
+        return nullopt;
+    }
+
+    return future.attr("result")();
+}
+
+void AsyncioLoop::stop()
+{
+    map<PyInterpreterState*, Loop> stopping;
+    {
+        lock_guard lock(loops_mutex);
+        stopping.swap(loops);
+    }
+
+    for (auto &[interpreter, loop] : stopping)
+    {
+        try {
+            InterpreterGil acquire(interpreter);
+            loop.loop.attr("call_soon_threadsafe")(loop.loop.attr("stop"));
+            loop.thread.attr("join")(JOIN_TIMEOUT);
+            loop.loop.attr("close")();  // Throws if still running
+            loop = {};
+        } catch (const exception &e) {
+            WARN << "Failed stopping asyncio event loop:" << e.what();
+            // Leak, the GIL is not held anymore
+            loop.loop.release();
+            loop.thread.release();
+            loop.await.release();
+        }
+    }
+}
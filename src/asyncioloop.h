@@ -0,0 +1,30 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#pragma once
+#include <pybind11/pybind11.h>
+#include <functional>
+#include <optional>
+
+
+///
+/// Drives the coroutines of Python query handlers.
+///
+/// Each interpreter gets one asyncio event loop, running in a daemon thread created on first use.
+/// Workers schedule awaitables on it and wait for their results without holding the GIL, such that
+/// the I/O waits of concurrent queries overlap instead of queueing on the GIL.
+///
+namespace AsyncioLoop
+{
+
+/// Runs _awaitable_ on the event loop of the current interpreter and returns its result. Returns
+/// nullopt if _cancelled_ returned true while waiting, the awaitable is cancelled then. Requires
+/// the GIL, which is released while waiting. The GIL is taken again only when the awaitable is
+/// done or cancelled. _cancelled_ is called without the GIL. Throws the exceptions of the
+/// awaitable.
+std::optional<pybind11::object> run(const pybind11::object &awaitable,
+                                    const std::function<bool()> &cancelled = {});
+
+/// Stops the event loops and joins their threads. Requires the GIL to be released.
+void stop();
+
+}
@@ -6,11 +6,15 @@
 
 #include <QString>
 #include <QStringList>
-#include <list>
+#include <algorithm>
 namespace py = pybind11;
 
 
 //  str <-> QString
+//
+//  Strings cross the boundary constantly (ids, texts, queries). Decode the compact
+//  representation of str (latin-1, UCS-2, UCS-4) directly into the QString and encode str
+//  directly from the UTF-16 data of the QString, without intermediate copies.
 
 namespace pybind11 {
 namespace detail {
@@ -19,19 +23,64 @@ template <>
 struct type_caster<QString>
 {
     PYBIND11_TYPE_CASTER(QString, _("str"));
-private:
-    using str_caster_t = make_caster<std::u16string>;
-    str_caster_t str_caster;
 public:
-    bool load(handle src, bool convert) {
-        if (str_caster.load(src, convert)) {
-            value = QString::fromStdU16String(str_caster);
+    bool load(handle src, bool) {
+        if (!src || !PyUnicode_Check(src.ptr()))
+            return false;
+
+        PyObject *o = src.ptr();
+#if PY_VERSION_HEX < 0x030C0000
+        if (PyUnicode_READY(o) != 0) {
+            PyErr_Clear();
+            return false;
+        }
+#endif
+        const auto length = static_cast<qsizetype>(PyUnicode_GET_LENGTH(o));
+        const void *data = PyUnicode_DATA(o);
+        switch (PyUnicode_KIND(o)) {
+        case PyUnicode_1BYTE_KIND:
+            value = QString::fromLatin1(static_cast<const char *>(data), length);
+            return true;
+        case PyUnicode_2BYTE_KIND:
+            value = QString(reinterpret_cast<const QChar *>(data), length);
             return true;
+        case PyUnicode_4BYTE_KIND:
+            value = QString::fromUcs4(static_cast<const char32_t *>(data), length);
+            return true;
+        default:
+            return false;
         }
-        return false;
     }
-    static handle cast(const QString &s, return_value_policy policy, handle parent) {
-        return str_caster_t::cast(s.toStdU16String(), policy, parent);
+    static handle cast(const QString &s, return_value_policy, handle) {
+        const auto *begin = s.utf16();
+        const auto *end = begin + s.size();
+
+        // One pass for the kind. All units are below 0x100 iff the or of them is.
+        char16_t bits = 0;
+        bool surrogates = false;
+        for (auto *c = begin; c != end; ++c) {
+            bits |= *c;
+            surrogates |= QChar::isSurrogate(*c);
+        }
+
+        if (bits < 0x100) {
+            PyObject *o = PyUnicode_New(s.size(), bits < 0x80 ? 0x7f : 0xff);
+            if (o)
+                std::copy(begin, end, PyUnicode_1BYTE_DATA(o));
+            return o;
+        }
+
+        // Without surrogate pairs the UTF-16 units are the code points
+        if (!surrogates) {
+            PyObject *o = PyUnicode_New(s.size(), 0xffff);
+            if (o)
+                std::copy(begin, end, PyUnicode_2BYTE_DATA(o));
+            return o;
+        }
+
+        int byte_order = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? -1 : 1;
+        return PyUnicode_DecodeUTF16(reinterpret_cast<const char *>(begin),
+                                     s.size() * 2, "surrogatepass", &byte_order);
     }
 };
 
@@ -41,20 +90,32 @@ public:
 template <>
 struct type_caster<QStringList> {
 PYBIND11_TYPE_CASTER(QStringList, _("list[str]"));
-private:
-    using list_caster_t = make_caster<std::list<QString>>;
-    list_caster_t list_caster;
 public:
     bool load(handle src, bool convert) {
-        if (list_caster.load(src, convert)) {
-            auto lc = static_cast<std::list<QString>>(list_caster);
-            value = QStringList(lc.cbegin(), lc.cend());
-            return true;
+        if (!isinstance<sequence>(src) || isinstance<bytes>(src) || isinstance<str>(src))
+            return false;
+
+        auto seq = reinterpret_borrow<sequence>(src);
+        QStringList list;
+        list.reserve(seq.size());
+        make_caster<QString> caster;
+        for (const auto &item : seq) {
+            if (!caster.load(item, convert))
+                return false;
+            list.emplace_back(cast_op<QString &&>(std::move(caster)));
         }
-        return false;
+        value = std::move(list);
+        return true;
     }
     static handle cast(const QStringList &s, return_value_policy policy, handle parent) {
-        return list_caster_t::cast(std::list<QString>{s.cbegin(), s.cend()}, policy, parent);
+        list l(s.size());
+        for (qsizetype i = 0; i < s.size(); ++i) {
+            auto item = reinterpret_steal<object>(make_caster<QString>::cast(s[i], policy, parent));
+            if (!item)
+                return handle();
+            PyList_SET_ITEM(l.ptr(), i, item.release().ptr());
+        }
+        return l.release();
     }
 };
 
@@ -32,25 +32,33 @@ using namespace std;
  * execution and deletion.
  */
 struct GilAwareFunctor {
+    PyInterpreterState *interpreter;
     py::object callable;
-    GilAwareFunctor(const py::object &c) : callable(c){}
+    GilAwareFunctor(const py::object &c) : interpreter(currentInterpreter()), callable(c){}
     GilAwareFunctor(GilAwareFunctor&&) = default;
     GilAwareFunctor & operator=(GilAwareFunctor&&) = default;
-    GilAwareFunctor(const GilAwareFunctor &other){
-        py::gil_scoped_acquire acquire;
+    GilAwareFunctor(const GilAwareFunctor &other) : interpreter(other.interpreter){
+        InterpreterGil acquire(interpreter);
         callable = other.callable;
     }
     GilAwareFunctor & operator=(const GilAwareFunctor &other){
-        py::gil_scoped_acquire acquire;
+        InterpreterGil acquire(other.interpreter);
+        interpreter = other.interpreter;
         callable = other.callable;
         return *this;
     }
     ~GilAwareFunctor(){
-        py::gil_scoped_acquire acquire;
-        callable = py::object();
+        if (callable)
+        {
+            InterpreterGil acquire(interpreter, std::nothrow);
+            if (acquire.isAcquired())
+                callable = py::object();
+            else  // Outlived its interpreter
+                callable.release();
+        }
     }
     void operator()() {
-        py::gil_scoped_acquire acquire;
+        InterpreterGil acquire(interpreter);
         callable();
     }
 };
@@ -97,7 +105,18 @@ public:
     }
 };
 
+// Free-threaded builds only: the module is thread-safe without a GIL. Shared state is guarded by
+// mutexes, see testFreeThreading.
+#if defined(Py_GIL_DISABLED) && ALBERT_PYTHON_SUBINTERPRETERS
+PYBIND11_EMBEDDED_MODULE(albert, m, py::mod_gil_not_used(),
+                         py::multiple_interpreters::per_interpreter_gil())
+#elif defined(Py_GIL_DISABLED)
+PYBIND11_EMBEDDED_MODULE(albert, m, py::mod_gil_not_used())
+#elif ALBERT_PYTHON_SUBINTERPRETERS
+PYBIND11_EMBEDDED_MODULE(albert, m, py::multiple_interpreters::per_interpreter_gil())
+#else
 PYBIND11_EMBEDDED_MODULE(albert, m)
+#endif
 {
 
     // ------------------------------------------------------------------------
@@ -209,6 +228,74 @@ PYBIND11_EMBEDDED_MODULE(albert, m)
         .def_property("input_action_text",
                       &StandardItem::inputActionText,
                       &StandardItem::setInputActionText)
+
+        // Converts the columns in native loops instead of dispatching a constructor per item.
+        // Icon factory and actions are either shared by all items or given per item.
+        .def_static("many",
+                    [](vector<QString> ids,
+                       optional<vector<QString>> texts,
+                       optional<vector<QString>> subtexts,
+                       const py::object &icon_factory,
+                       const py::object &actions,
+                       optional<vector<QString>> input_action_texts)
+                    {
+                        using IconFactory = function<unique_ptr<Icon>()>;
+                        const auto n = ids.size();
+                        const auto check = [n](size_t size, const char *column) {
+                            if (size != n)
+                                throw py::value_error(u"Length of '%1' (%2) does not match the "
+                                                      "length of 'ids' (%3)."_s
+                                                      .arg(column).arg(size).arg(n).toStdString());
+                        };
+
+                        if (texts)
+                            check(texts->size(), "texts");
+                        if (subtexts)
+                            check(subtexts->size(), "subtexts");
+                        if (input_action_texts)
+                            check(input_action_texts->size(), "input_action_texts");
+
+                        IconFactory shared_icon_factory;
+                        vector<IconFactory> icon_factories;
+                        if (py::isinstance<py::list>(icon_factory))
+                        {
+                            icon_factories = icon_factory.cast<vector<IconFactory>>();
+                            check(icon_factories.size(), "icon_factory");
+                        }
+                        else if (!icon_factory.is_none())
+                            shared_icon_factory = icon_factory.cast<IconFactory>();
+
+                        vector<Action> shared_actions;
+                        vector<vector<Action>> item_actions;
+                        if (py::isinstance<py::list>(actions)
+                            && py::len(actions) > 0
+                            && py::isinstance<py::list>(actions[py::int_(0)]))
+                        {
+                            item_actions = actions.cast<vector<vector<Action>>>();
+                            check(item_actions.size(), "actions");
+                        }
+                        else if (!actions.is_none())
+                            shared_actions = actions.cast<vector<Action>>();
+
+                        vector<shared_ptr<StandardItem>> items;
+                        items.reserve(n);
+                        for (size_t i = 0; i < n; ++i)
+                            items.emplace_back(make_shared<StandardItem>(
+                                ::move(ids[i]),
+                                texts ? ::move((*texts)[i]) : QString(),
+                                subtexts ? ::move((*subtexts)[i]) : QString(),
+                                icon_factories.empty() ? shared_icon_factory
+                                                       : ::move(icon_factories[i]),
+                                item_actions.empty() ? shared_actions : ::move(item_actions[i]),
+                                input_action_texts ? ::move((*input_action_texts)[i]) : QString()));
+                        return items;
+                    },
+                    py::arg("ids"),
+                    py::arg("texts") = py::none(),
+                    py::arg("subtexts") = py::none(),
+                    py::arg("icon_factory") = py::none(),
+                    py::arg("actions") = py::none(),
+                    py::arg("input_action_texts") = py::none())
         ;
 
     // ------------------------------------------------------------------------
@@ -312,16 +399,19 @@ PYBIND11_EMBEDDED_MODULE(albert, m)
                >(m, "QueryContext")
 
         .def_property_readonly("trigger",
-                               &QueryContext::trigger)
+                               &QueryScope::trigger)
 
         .def_property_readonly("query",
-                               &QueryContext::query)
+                               &QueryScope::query)
 
         .def_property_readonly("isValid",
                                &QueryContext::isValid)
 
         .def_property_readonly("usageScoring",
-                               &QueryContext::usageScoring)
+                               &QueryScope::usageScoring)
+
+        .def_property_readonly("cancellation",
+                               &QueryScope::cancellationEvent)
         ;
 
     // py::class_<QueryResults>(m, "QueryResults")
@@ -516,7 +606,10 @@ PYBIND11_EMBEDDED_MODULE(albert, m)
              &IndexQueryHandler::updateIndexItems)
 
         .def("setIndexItems",
-             &IndexQueryHandler::setIndexItems,
+             [](IndexQueryHandler &self, vector<IndexItem> index_items) {
+                 ItemSnapshot::apply(index_items);
+                 self.setIndexItems(::move(index_items));
+             },
              py::arg("index_items"))
         ;
 
@@ -0,0 +1,220 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#include "gcpolicy.h"
+#include "subinterpreters.h"
+#include <QJsonArray>
+#include <QtConcurrentRun>
+#include <albert/logging.h>
+#include <array>
+#include <atomic>
+namespace py = pybind11;
+using namespace Qt::StringLiterals;
+using namespace std::chrono;
+using namespace std;
+
+namespace {
+
+const auto FREEZE_DELAY = 3s;        // after the last load
+const auto COLLECT_DELAY = 1s;       // after the last collection request
+const auto IDLE_CHECK_INTERVAL = 5s;
+const auto IDLE_DELAY = 5s;          // after the last query
+const auto SLOW_PAUSE = 20ms;
+
+atomic<steady_clock::rep> last_activity{0};
+
+// Static since gc.callbacks may run as long as the interpreters live
+struct PauseStats
+{
+    mutex mtx;
+    array<int, 3> collections{};
+    array<double, 3> max_ms{};
+    double total_ms = 0.;
+    qint64 collected = 0;
+};
+
+PauseStats &pauseStats()
+{
+    static PauseStats stats;
+    return stats;
+}
+
+thread_local steady_clock::time_point collection_start;
+
+void recordPhase(const py::str &phase, const py::dict &info)
+{
+    if (PyUnicode_CompareWithASCIIString(phase.ptr(), "start") == 0)
+    {
+        collection_start = steady_clock::now();
+        return;
+    }
+
+    const auto pause = steady_clock::now() - collection_start;
+    const double ms = duration<double, milli>(pause).count();
+    const auto generation = clamp(info["generation"].cast<int>(), 0, 2);
+    const auto collected = info["collected"].cast<qint64>();
+
+    {
+        auto &stats = pauseStats();
+        lock_guard lock(stats.mtx);
+        ++stats.collections[generation];
+        stats.max_ms[generation] = max(stats.max_ms[generation], ms);
+        stats.total_ms += ms;
+        stats.collected += collected;
+    }
+
+    if (pause > SLOW_PAUSE)
+        DEBG << u"Garbage collection of generation %1 paused for %2 ms (%3 collected)"_s
+                    .arg(generation).arg(ms, 0, 'f', 1).arg(collected);
+}
+
+}
+
+GcPolicy::GcPolicy():
+    frozen_(false),
+    frozen_objects_(0)
+{
+    freeze_timer_.setSingleShot(true);
+    freeze_timer_.setInterval(FREEZE_DELAY);
+    QObject::connect(&freeze_timer_, &QTimer::timeout, [this] { freeze(); });
+
+    collect_timer_.setSingleShot(true);
+    collect_timer_.setInterval(COLLECT_DELAY);
+    QObject::connect(&collect_timer_, &QTimer::timeout, [this] { collectRequested(); });
+
+    idle_timer_.setInterval(IDLE_CHECK_INTERVAL);
+    QObject::connect(&idle_timer_, &QTimer::timeout, [this] { collectIdle(); });
+    idle_timer_.start();
+}
+
+GcPolicy::~GcPolicy()
+{
+    freeze_timer_.stop();
+    collect_timer_.stop();
+    idle_timer_.stop();
+    collection_.waitForFinished();
+
+    // Flush the requests of the debounce window, e.g. to run __del__ of unloaded plugins
+    {
+        lock_guard lock(mutex_);
+        if (!requested_.empty())
+            run(::move(requested_), 2, frozen_);
+        requested_.clear();
+    }
+    collection_.waitForFinished();
+}
+
+void GcPolicy::instrument()
+{
+    py::module::import("gc").attr("callbacks").attr("append")(py::cpp_function(&recordPhase));
+}
+
+void GcPolicy::recordActivity()
+{ last_activity.store(steady_clock::now().time_since_epoch().count(), memory_order_relaxed); }
+
+void GcPolicy::loadFinished()
+{ QMetaObject::invokeMethod(&freeze_timer_, [this] { freeze_timer_.start(); }); }
+
+void GcPolicy::requestCollection(PyInterpreterState *interpreter)
+{
+    {
+        lock_guard lock(mutex_);
+        requested_.insert(interpreter == PyInterpreterState_Main() ? nullptr : interpreter);
+    }
+    QMetaObject::invokeMethod(&collect_timer_, [this] { collect_timer_.start(); });
+}
+
+void GcPolicy::freeze()
+{
+    if (collection_.isRunning())
+    {
+        freeze_timer_.start();  // retry
+        return;
+    }
+
+    // Collects first, garbage would become immortal
+    lock_guard lock(mutex_);
+    frozen_ = true;
+    run({nullptr}, 2, true);
+}
+
+void GcPolicy::collectRequested()
+{
+    if (collection_.isRunning())
+    {
+        collect_timer_.start();  // retry
+        return;
+    }
+
+    // Frozen garbage of unloaded plugins has to be unfrozen to be collected
+    lock_guard lock(mutex_);
+    run(::move(requested_), 2, frozen_);
+    requested_.clear();
+}
+
+void GcPolicy::collectIdle()
+{
+    const auto activity = steady_clock::time_point(
+        steady_clock::duration(last_activity.load(memory_order_relaxed)));
+
+    if (activity <= idle_collection_
+        || steady_clock::now() - activity < IDLE_DELAY
+        || collection_.isRunning())
+        return;
+
+    idle_collection_ = steady_clock::now();
+    run({nullptr}, 2, false);
+}
+
+void GcPolicy::run(set<PyInterpreterState*> interpreters, int generation, bool refreeze)
+{
+    collection_ = QtConcurrent::run([this, interpreters = ::move(interpreters), generation, refreeze]
+    {
+        for (auto *interpreter : interpreters)
+        {
+            try {
+                InterpreterGil acquire(interpreter);
+                const auto gc = py::module::import("gc");
+                const bool main = interpreter == nullptr;
+
+                if (main && refreeze)
+                    gc.attr("unfreeze")();
+
+                gc.attr("collect")(generation);
+
+                if (main && refreeze)
+                {
+                    gc.attr("freeze")();
+                    const auto count = gc.attr("get_freeze_count")().cast<qint64>();
+                    lock_guard lock(mutex_);
+                    frozen_objects_ = count;
+                }
+            } catch (const exception &e) {
+                DEBG << "Garbage collection failed:" << e.what();
+            }
+        }
+    });
+}
+
+QJsonObject GcPolicy::state() const
+{
+    QJsonObject state;
+    {
+        auto &stats = pauseStats();
+        lock_guard lock(stats.mtx);
+        state.insert(u"collections"_s, QJsonArray{stats.collections[0],
+                                                  stats.collections[1],
+                                                  stats.collections[2]});
+        state.insert(u"max_pause_ms"_s, QJsonArray{stats.max_ms[0],
+                                                   stats.max_ms[1],
+                                                   stats.max_ms[2]});
+        state.insert(u"total_pause_ms"_s, stats.total_ms);
+        state.insert(u"collected"_s, stats.collected);
+    }
+    {
+        lock_guard lock(mutex_);
+        state.insert(u"frozen"_s, frozen_);
+        state.insert(u"frozen_objects"_s, frozen_objects_);
+        state.insert(u"requested"_s, static_cast<int>(requested_.size()));
+    }
+    return state;
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#pragma once
+#include <pybind11/gil.h>
+#include <QFuture>
+#include <QJsonObject>
+#include <QTimer>
+#include <chrono>
+#include <mutex>
+#include <set>
+
+
+///
+/// Garbage collection policy of the embedded interpreters.
+///
+/// Plugins create large heaps of long-lived objects at startup (modules, indexes), which every
+/// full collection traverses. Once the startup loads settled, these are moved to the permanent
+/// generation using gc.freeze(). Full collections requested by unloads are coalesced into one
+/// deferred collection. Full collections are run when the queries went idle, such that the
+/// automatic ones rarely land in the middle of typing. Collections run on the thread pool.
+///
+/// Pause times are instrumented using gc.callbacks.
+///
+class GcPolicy
+{
+public:
+
+    GcPolicy();
+
+    /// Waits for a running collection, then runs the pending requested collections.
+    /// The interpreters have to be alive.
+    ~GcPolicy();
+
+    /// Installs the pause instrumentation in the current interpreter. Requires the GIL.
+    static void instrument();
+
+    /// Records query activity. Cheap. Thread-safe.
+    static void recordActivity();
+
+    /// Defers freezing the objects alive until the loads settled. Call when a plugin finished
+    /// loading. Thread-safe.
+    void loadFinished();
+
+    /// Requests a full collection of _interpreter_, e.g. to run __del__ of an unloaded plugin.
+    /// Requests are coalesced. Thread-safe.
+    void requestCollection(PyInterpreterState *interpreter);
+
+    /// Returns the collection statistics for debugging. Thread-safe.
+    QJsonObject state() const;
+
+private:
+
+    void collectRequested();
+    void collectIdle();
+    void freeze();
+    void run(std::set<PyInterpreterState*> interpreters, int generation, bool refreeze);
+
+    mutable std::mutex mutex_;
+    std::set<PyInterpreterState*> requested_;
+    bool frozen_;
+    qint64 frozen_objects_;
+    QFuture<void> collection_;
+    std::chrono::steady_clock::time_point idle_collection_;
+
+    QTimer freeze_timer_;
+    QTimer collect_timer_;
+    QTimer idle_timer_;
+
+};
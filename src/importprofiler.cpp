@@ -0,0 +1,104 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#include "cast_specialization.hpp"
+// import pybind first
+
+#include "importprofiler.h"
+#include <QSaveFile>
+#include <albert/logging.h>
+#include <mutex>
+namespace py = pybind11;
+using namespace Qt::StringLiterals;
+using namespace std::chrono;
+using namespace std;
+
+static thread_local ImportProfiler *current_profiler = nullptr;
+
+struct ImportHook
+{
+    // The interpreter calls _find_and_load of the frozen importlib for every module not in
+    // sys.modules. Replace it by a wrapper that reports to the profiler of the calling thread.
+    static void install()
+    {
+#ifdef Py_GIL_DISABLED
+        static mutex install_mutex;  // No GIL serializing the check and the installation
+        lock_guard lock(install_mutex);
+#endif
+
+        // Once per interpreter
+        auto bootstrap = py::module::import("_frozen_importlib");
+        if (py::hasattr(bootstrap, "_albert_import_hook"))
+            return;
+        auto original = bootstrap.attr("_find_and_load");
+        bootstrap.attr("_find_and_load") = py::cpp_function([original](py::args args) -> py::object
+        {
+            auto *profiler = current_profiler;
+            if (!profiler)
+                return original(*args);
+
+            profiler->begin(args.empty() ? QString() : py::str(args[0]).cast<QString>());
+            try {
+                auto module = original(*args);
+                profiler->end();
+                return module;
+            } catch (...) {
+                profiler->end();
+                throw;
+            }
+        });
+
+        bootstrap.attr("_albert_import_hook") = true;
+    }
+};
+
+ImportProfiler::ImportProfiler() : previous_(current_profiler)
+{
+    ImportHook::install();
+    current_profiler = this;
+}
+
+ImportProfiler::~ImportProfiler() { current_profiler = previous_; }
+
+void ImportProfiler::begin(const QString &module)
+{ stack_.push_back({.module = module, .begin = steady_clock::now(), .children = {}}); }
+
+void ImportProfiler::end()
+{
+    const auto frame = ::move(stack_.back());
+    stack_.pop_back();
+
+    const auto cumulative = duration_cast<microseconds>(steady_clock::now() - frame.begin);
+    records_.push_back({.module = frame.module,
+                        .depth = static_cast<int>(stack_.size()),
+                        .self = cumulative - frame.children,
+                        .cumulative = cumulative});
+
+    if (!stack_.empty())
+        stack_.back().children += cumulative;
+}
+
+const vector<ImportProfiler::Record> &ImportProfiler::records() const { return records_; }
+
+QString ImportProfiler::report() const
+{
+    QString report = u"import time: self [us] | cumulative | imported package\n"_s;
+    for (const auto &r : records_)
+        report += u"import time: %1 | %2 | %3%4\n"_s
+                      .arg(r.self.count(), 9)
+                      .arg(r.cumulative.count(), 10)
+                      .arg(QString(r.depth * 2 + 1, u' '), r.module);
+    return report;
+}
+
+bool ImportProfiler::save(const QString &file_path) const
+{
+    QSaveFile file(file_path);
+    if (file.open(QIODevice::WriteOnly))
+    {
+        file.write(report().toUtf8());
+        if (file.commit())
+            return true;
+    }
+    WARN << "Failed writing import profile" << file_path << file.errorString();
+    return false;
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#pragma once
+#include <QString>
+#include <chrono>
+#include <vector>
+
+
+///
+/// Measures the imports executed by the current thread during the lifetime of the profiler.
+///
+/// Similar to `python -X importtime`, but scoped. Hooks the import system on first use. Only
+/// modules not yet in `sys.modules` are measured, i.e. the ones that are actually executed.
+/// Construction, destruction and all imports in between require the GIL.
+///
+class ImportProfiler
+{
+public:
+
+    struct Record
+    {
+        QString module;
+        int depth;
+        std::chrono::microseconds self;
+        std::chrono::microseconds cumulative;
+    };
+
+    ImportProfiler();
+    ~ImportProfiler();
+
+    ImportProfiler(const ImportProfiler &) = delete;
+    ImportProfiler &operator=(const ImportProfiler &) = delete;
+
+    /// Returns the measured imports in order of completion, i.e. dependencies first.
+    const std::vector<Record> &records() const;
+
+    /// Returns the records in the format of `python -X importtime`.
+    QString report() const;
+
+    /// Writes the report to _file_path_. Returns false on failure.
+    bool save(const QString &file_path) const;
+
+private:
+
+    struct Frame
+    {
+        QString module;
+        std::chrono::steady_clock::time_point begin;
+        std::chrono::microseconds children;
+    };
+
+    void begin(const QString &module);
+    void end();
+
+    ImportProfiler *const previous_;  // Nested profilers, e.g. lazy activations in imports
+    std::vector<Frame> stack_;
+    std::vector<Record> records_;
+
+    friend struct ImportHook;
+
+};
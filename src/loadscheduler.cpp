@@ -0,0 +1,264 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#include "loadscheduler.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QPromise>
+#include <QSaveFile>
+#include <QtConcurrentRun>
+#include <albert/logging.h>
+#include <albert/systemutil.h>
+#include <algorithm>
+#include <chrono>
+using namespace Qt::StringLiterals;
+using namespace albert;
+using namespace std::chrono;
+using namespace std;
+
+namespace {
+
+const int FORMAT_VERSION = 1;
+const double USAGE_DECAY = 0.9;  // per session
+const double LOAD_COST_SMOOTHING = 0.5;
+
+const auto &k_format   = u"format_version"_s;
+const auto &k_plugins  = u"plugins"_s;
+const auto &k_uses     = u"uses"_s;
+const auto &k_load_ms  = u"load_ms"_s;
+
+}
+
+atomic<LoadScheduler*> LoadScheduler::instance_ = nullptr;
+
+LoadScheduler::LoadScheduler(const filesystem::path &stats_file_path):
+    file_path_(stats_file_path),
+    draining_(false),
+    active_(0)
+{
+    if (QFile file(file_path_); file.exists())
+    {
+        if (!file.open(QIODevice::ReadOnly))
+            WARN << "Failed reading load statistics" << file.fileName() << file.errorString();
+        else if (const auto root = QJsonDocument::fromJson(file.readAll()).object();
+                 root[k_format].toInt() == FORMAT_VERSION)
+        {
+            const auto plugins = root[k_plugins].toObject();
+            for (auto it = plugins.begin(); it != plugins.end(); ++it)
+            {
+                const auto o = it.value().toObject();
+                stats_.emplace(it.key(), Stats{.uses = o[k_uses].toDouble() * USAGE_DECAY,
+                                               .load_ms = o[k_load_ms].toDouble()});
+            }
+        }
+    }
+
+    instance_ = this;
+}
+
+LoadScheduler::~LoadScheduler()
+{
+    instance_ = nullptr;
+    waitForFinished();
+    save();
+}
+
+void LoadScheduler::save() const
+{
+    QJsonObject plugins;
+    {
+        lock_guard lock(mutex_);
+        for (const auto &[id, stats] : stats_)
+            plugins.insert(id, QJsonObject{{k_uses, stats.uses}, {k_load_ms, stats.load_ms}});
+    }
+
+    filesystem::create_directories(file_path_.parent_path());
+
+    QSaveFile file(toQString(file_path_));
+    if (file.open(QIODevice::WriteOnly))
+    {
+        file.write(QJsonDocument(QJsonObject{
+            {k_format, FORMAT_VERSION},
+            {k_plugins, plugins}
+        }).toJson(QJsonDocument::Compact));
+
+        if (!file.commit())
+            WARN << "Failed writing load statistics" << file.fileName() << file.errorString();
+    }
+    else
+        WARN << "Failed opening load statistics" << file.fileName() << file.errorString();
+}
+
+QFuture<void> LoadScheduler::schedule(const QString &plugin_id,
+                                      function<void()> dependencies,
+                                      function<void()> import)
+{
+    auto promise = make_shared<QPromise<void>>();
+    promise->start();
+    auto future = promise->future();
+
+    {
+        lock_guard lock(mutex_);
+        ++active_;
+        dependency_phase_.emplace_back(plugin_id);
+    }
+
+    auto task = [this, plugin_id, dependencies = ::move(dependencies),
+                 import = ::move(import), promise]() mutable
+    {
+        bool failed = false;
+        try {
+            dependencies();
+        } catch (...) {
+            promise->setException(current_exception());
+            failed = true;
+        }
+
+        {
+            lock_guard lock(mutex_);
+            dependency_phase_.erase(ranges::find(dependency_phase_, plugin_id));
+        }
+
+        if (failed || !import)
+            finish(promise);
+        else
+            enqueue({.plugin_id = plugin_id, .import = ::move(import), .promise = promise});
+    };
+
+    QtConcurrent::run(::move(task));
+    return future;
+}
+
+void LoadScheduler::enqueue(Job &&job)
+{
+    lock_guard lock(mutex_);
+    import_queue_.emplace_back(::move(job));
+
+    // Imports hold the GIL. A single worker suffices.
+    if (!draining_)
+    {
+        draining_ = true;
+        QtConcurrent::run([this] { drain(); });
+    }
+}
+
+void LoadScheduler::drain()
+{
+    while (true)
+    {
+        Job job;
+        {
+            lock_guard lock(mutex_);
+            importing_.clear();
+
+            if (import_queue_.empty())
+            {
+                draining_ = false;
+                idle_.notify_all();
+                return;
+            }
+
+            auto it = ranges::max_element(import_queue_, {}, [this](const Job &j)
+                                          { return priorityLocked(j.plugin_id); });
+            job = ::move(*it);
+            import_queue_.erase(it);
+            importing_ = job.plugin_id;
+
+            DEBG << u"Importing %1 (priority %2, %3 queued)"_s
+                        .arg(job.plugin_id)
+                        .arg(priorityLocked(job.plugin_id), 0, 'g', 3)
+                        .arg(import_queue_.size());
+        }
+
+        const auto tp = steady_clock::now();
+        try {
+            job.import();
+
+            const double ms = duration<double, milli>(steady_clock::now() - tp).count();
+            lock_guard lock(mutex_);
+            if (auto [it, inserted] = stats_.try_emplace(job.plugin_id, Stats{0., ms}); !inserted)
+                it->second.load_ms = LOAD_COST_SMOOTHING * ms
+                                     + (1. - LOAD_COST_SMOOTHING) * it->second.load_ms;
+        } catch (...) {
+            job.promise->setException(current_exception());
+        }
+
+        finish(job.promise);
+    }
+}
+
+void LoadScheduler::finish(const shared_ptr<QPromise<void>> &promise)
+{
+    promise->finish();
+
+    lock_guard lock(mutex_);
+    if (--active_ == 0)
+        idle_.notify_all();
+}
+
+void LoadScheduler::waitForFinished()
+{
+    unique_lock lock(mutex_);
+    idle_.wait(lock, [this] { return active_ == 0 && !draining_; });
+}
+
+void LoadScheduler::registerHandlers(const QString &plugin_id, const vector<Extension*> &handlers)
+{
+    lock_guard lock(mutex_);
+    for (const auto *handler : handlers)
+        handlers_.insert_or_assign(handler, plugin_id);
+}
+
+void LoadScheduler::unregisterHandlers(const QString &plugin_id)
+{
+    lock_guard lock(mutex_);
+    erase_if(handlers_, [&](const auto &pair) { return pair.second == plugin_id; });
+}
+
+void LoadScheduler::recordUse(const Extension *handler)
+{
+    if (auto *scheduler = instance_.load())
+    {
+        lock_guard lock(scheduler->mutex_);
+        if (auto it = scheduler->handlers_.find(handler); it != scheduler->handlers_.end())
+            scheduler->stats_[it->second].uses += 1.;
+    }
+}
+
+double LoadScheduler::priority(const QString &plugin_id) const
+{
+    lock_guard lock(mutex_);
+    return priorityLocked(plugin_id);
+}
+
+double LoadScheduler::priorityLocked(const QString &plugin_id) const
+{
+    // Unknown plugins are assumed to be cheap
+    if (auto it = stats_.find(plugin_id); it != stats_.end())
+        return (1. + it->second.uses) / (1. + it->second.load_ms);
+    return 1.;
+}
+
+QJsonObject LoadScheduler::state() const
+{
+    lock_guard lock(mutex_);
+
+    QJsonArray queue;
+    for (const auto &job : import_queue_)
+        queue.append(QJsonObject{{u"plugin"_s, job.plugin_id},
+                                 {u"priority"_s, priorityLocked(job.plugin_id)}});
+
+    QJsonObject stats;
+    for (const auto &[id, s] : stats_)
+        stats.insert(id, QJsonObject{{k_uses, s.uses},
+                                     {k_load_ms, s.load_ms},
+                                     {u"priority"_s, priorityLocked(id)}});
+
+    return {
+        {u"dependency_phase"_s, QJsonArray::fromStringList(QStringList(dependency_phase_.begin(),
+                                                                      dependency_phase_.end()))},
+        {u"import_queue"_s, queue},
+        {u"importing"_s, importing_},
+        {u"statistics"_s, stats}
+    };
+}
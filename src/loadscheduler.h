@@ -0,0 +1,101 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#pragma once
+#include <QFuture>
+#include <QJsonObject>
+#include <QString>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+namespace albert { class Extension; }
+template<typename T> class QPromise;
+
+
+///
+/// Schedules the loads of Python plugins.
+///
+/// The dependency phases of the loads (binary checks, package installations) do not require the
+/// GIL and run concurrently on the global thread pool. Imports are serialized by the GIL anyway.
+/// These are queued and executed one after another in order of priority, such that frequently
+/// used plugins that are cheap to load come online first.
+///
+/// The priority is the weighted-shortest-job-first ratio of the usage and the load cost recorded
+/// in former sessions. Usage is the number of triggered queries handled by the plugin, decayed
+/// per session. Load cost is the moving average of the measured import time.
+///
+class LoadScheduler
+{
+public:
+
+    /// Constructs the scheduler and reads the statistics persisted in _file_path_, if any.
+    explicit LoadScheduler(const std::filesystem::path &stats_file_path);
+
+    /// Waits for scheduled loads and persists the statistics.
+    ~LoadScheduler();
+
+    /// Runs _dependencies_ on the thread pool, then _import_ in order of priority.
+    /// _import_ may be empty. Returns a future reporting the exceptions thrown. Thread-safe.
+    QFuture<void> schedule(const QString &plugin_id,
+                           std::function<void()> dependencies,
+                           std::function<void()> import);
+
+    /// Blocks until all scheduled loads finished.
+    void waitForFinished();
+
+    /// Associates _handlers_ with the plugin _plugin_id_ for usage recording.
+    void registerHandlers(const QString &plugin_id, const std::vector<albert::Extension*> &handlers);
+
+    /// Removes the handler associations of the plugin _plugin_id_.
+    void unregisterHandlers(const QString &plugin_id);
+
+    /// Returns the priority of the plugin _plugin_id_. Higher values load first.
+    double priority(const QString &plugin_id) const;
+
+    /// Returns the state of the scheduler for debugging. Thread-safe.
+    QJsonObject state() const;
+
+    /// Persists the statistics.
+    void save() const;
+
+    /// Records a triggered query handled by _handler_. Cheap no-op for unknown handlers.
+    static void recordUse(const albert::Extension *handler);
+
+private:
+
+    struct Stats
+    {
+        double uses;
+        double load_ms;
+    };
+
+    struct Job
+    {
+        QString plugin_id;
+        std::function<void()> import;
+        std::shared_ptr<QPromise<void>> promise;
+    };
+
+    void enqueue(Job &&job);
+    void drain();
+    void finish(const std::shared_ptr<QPromise<void>> &promise);
+    double priorityLocked(const QString &plugin_id) const;
+
+    const std::filesystem::path file_path_;
+    mutable std::mutex mutex_;
+    std::condition_variable idle_;
+    std::map<QString, Stats> stats_;
+    std::map<const albert::Extension*, QString> handlers_;
+    std::vector<QString> dependency_phase_;
+    std::vector<Job> import_queue_;
+    QString importing_;
+    bool draining_;
+    uint active_;
+
+    static std::atomic<LoadScheduler*> instance_;
+
+};
@@ -0,0 +1,250 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#include "metadatacache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <albert/logging.h>
+#include <albert/systemutil.h>
+using namespace Qt::StringLiterals;
+using namespace albert;
+using namespace std;
+
+namespace {
+
+// Bump this if the set of cached metadata fields or their extraction changes
+const int FORMAT_VERSION = 3;
+
+// File systems have coarse timestamps. A file modified within this interval of reading it may be
+// modified again without changing its mtime. The stats of such entries are not trusted.
+const qint64 RACY_INTERVAL_MS = 2000;
+
+const auto &k_authors      = u"authors"_s;
+const auto &k_bin_deps     = u"binary_dependencies"_s;
+const auto &k_checked      = u"checked"_s;
+const auto &k_credits      = u"third_party_credits"_s;
+const auto &k_description  = u"description"_s;
+const auto &k_entries      = u"entries"_s;
+const auto &k_hash         = u"hash"_s;
+const auto &k_iid          = u"iid"_s;
+const auto &k_lazy_handler = u"lazy_handler"_s;
+const auto &k_lib_deps     = u"runtime_dependencies"_s;
+const auto &k_license      = u"license"_s;
+const auto &k_maintainers  = u"maintainers"_s;
+const auto &k_metadata     = u"metadata"_s;
+const auto &k_mtime        = u"mtime"_s;
+const auto &k_name         = u"name"_s;
+const auto &k_platforms    = u"platforms"_s;
+const auto &k_readme_url   = u"readme_url"_s;
+const auto &k_size         = u"size"_s;
+const auto &k_url          = u"url"_s;
+const auto &k_version      = u"version"_s;
+const auto &k_format       = u"format_version"_s;
+
+QJsonObject toJson(const PyPluginMetadata &m)
+{
+    return {
+        {k_iid, m.iid},
+        {k_version, m.version},
+        {k_name, m.name},
+        {k_description, m.description},
+        {k_license, m.license},
+        {k_url, m.url},
+        {k_readme_url, m.readme_url},
+        {k_authors, QJsonArray::fromStringList(m.authors)},
+        {k_maintainers, QJsonArray::fromStringList(m.maintainers)},
+        {k_lib_deps, QJsonArray::fromStringList(m.runtime_dependencies)},
+        {k_bin_deps, QJsonArray::fromStringList(m.binary_dependencies)},
+        {k_credits, QJsonArray::fromStringList(m.third_party_credits)},
+        {k_platforms, QJsonArray::fromStringList(m.platforms)},
+        {k_lazy_handler, QJsonArray::fromStringList(m.lazy_handler)}
+    };
+}
+
+QStringList toStringList(const QJsonValue &value)
+{
+    QStringList list;
+    for (const auto &v : value.toArray())
+        list << v.toString();
+    return list;
+}
+
+PyPluginMetadata fromJson(const QJsonObject &o)
+{
+    PyPluginMetadata m;
+    m.iid = o[k_iid].toString();
+    m.version = o[k_version].toString();
+    m.name = o[k_name].toString();
+    m.description = o[k_description].toString();
+    m.license = o[k_license].toString();
+    m.url = o[k_url].toString();
+    m.readme_url = o[k_readme_url].toString();
+    m.authors = toStringList(o[k_authors]);
+    m.maintainers = toStringList(o[k_maintainers]);
+    m.runtime_dependencies = toStringList(o[k_lib_deps]);
+    m.binary_dependencies = toStringList(o[k_bin_deps]);
+    m.third_party_credits = toStringList(o[k_credits]);
+    m.platforms = toStringList(o[k_platforms]);
+    m.lazy_handler = toStringList(o[k_lazy_handler]);
+    return m;
+}
+
+}
+
+MetadataCache::MetadataCache(const filesystem::path &file_path):
+    file_path_(file_path),
+    hits_(0),
+    misses_(0)
+{
+    load();
+}
+
+void MetadataCache::load()
+{
+    QFile file(file_path_);
+    if (!file.exists())
+        return;
+
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        WARN << "Failed reading metadata cache" << file.fileName() << file.errorString();
+        return;
+    }
+
+    const auto root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root[k_format].toInt() != FORMAT_VERSION)
+    {
+        DEBG << "Discarding metadata cache of different format version.";
+        return;
+    }
+
+    const auto entries = root[k_entries].toObject();
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+    {
+        const auto o = it.value().toObject();
+        entries_.emplace(it.key(),
+                         Entry{
+                             .mtime = o[k_mtime].toInteger(),
+                             .size = o[k_size].toInteger(),
+                             .checked = o[k_checked].toInteger(),
+                             .hash = QByteArray::fromHex(o[k_hash].toString().toLatin1()),
+                             .metadata = fromJson(o[k_metadata].toObject()),
+                             .used = false
+                         });
+    }
+}
+
+void MetadataCache::save() const
+{
+    QJsonObject entries;
+    {
+        lock_guard lock(mutex_);
+        for (const auto &[path, entry] : entries_)
+            if (entry.used)
+                entries.insert(path, QJsonObject{
+                    {k_mtime, entry.mtime},
+                    {k_size, entry.size},
+                    {k_checked, entry.checked},
+                    {k_hash, QString::fromLatin1(entry.hash.toHex())},
+                    {k_metadata, toJson(entry.metadata)}
+                });
+    }
+
+    filesystem::create_directories(file_path_.parent_path());
+
+    QSaveFile file(toQString(file_path_));
+    if (file.open(QIODevice::WriteOnly))
+    {
+        file.write(QJsonDocument(QJsonObject{
+            {k_format, FORMAT_VERSION},
+            {k_entries, entries}
+        }).toJson(QJsonDocument::Compact));
+
+        if (!file.commit())
+            WARN << "Failed writing metadata cache" << file.fileName() << file.errorString();
+    }
+    else
+        WARN << "Failed opening metadata cache" << file.fileName() << file.errorString();
+}
+
+PyPluginMetadata MetadataCache::metadata(const QString &source_path, const Extractor &extract)
+{
+    const QFileInfo file_info(source_path);
+    const auto mtime = file_info.lastModified().toMSecsSinceEpoch();
+    const auto size = file_info.size();
+
+    // Fast path: unchanged file stats, unless modified shortly before they were taken
+    {
+        lock_guard lock(mutex_);
+        if (auto it = entries_.find(source_path);
+            it != entries_.end() && it->second.mtime == mtime && it->second.size == size
+            && mtime + RACY_INTERVAL_MS <= it->second.checked)
+        {
+            it->second.used = true;
+            ++hits_;
+            return it->second.metadata;
+        }
+    }
+
+    const auto checked = QDateTime::currentMSecsSinceEpoch();
+    QByteArray source;
+    if (QFile file(source_path); file.open(QIODevice::ReadOnly))
+        source = file.readAll();
+    else
+        throw runtime_error(u"Can't open source file: %1"_s.arg(file.fileName()).toStdString());
+
+    const auto hash = QCryptographicHash::hash(source, QCryptographicHash::Sha1);
+
+    // Touched but unchanged content, e.g. after a checkout
+    {
+        lock_guard lock(mutex_);
+        if (auto it = entries_.find(source_path);
+            it != entries_.end() && it->second.size == size && it->second.hash == hash)
+        {
+            it->second.mtime = mtime;
+            it->second.checked = checked;
+            it->second.used = true;
+            ++hits_;
+            return it->second.metadata;
+        }
+    }
+
+    auto metadata = extract(source);  // may throw
+
+    lock_guard lock(mutex_);
+    entries_.insert_or_assign(source_path,
+                              Entry{
+                                  .mtime = mtime,
+                                  .size = size,
+                                  .checked = checked,
+                                  .hash = hash,
+                                  .metadata = metadata,
+                                  .used = true
+                              });
+    ++misses_;
+    return metadata;
+}
+
+uint MetadataCache::hits() const
+{
+    lock_guard lock(mutex_);
+    return hits_;
+}
+
+uint MetadataCache::misses() const
+{
+    lock_guard lock(mutex_);
+    return misses_;
+}
+
+void MetadataCache::resetCounters()
+{
+    lock_guard lock(mutex_);
+    hits_ = 0;
+    misses_ = 0;
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#pragma once
+#include <QByteArray>
+#include <QString>
+#include <albert/pluginmetadata.h>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+
+
+///
+/// Metadata of a Python plugin.
+///
+struct PyPluginMetadata : public albert::PluginMetadata
+{
+    /// Lazy handler declaration, `[<kind>, <id>, <default trigger>]`. Empty if not lazy.
+    QStringList lazy_handler;
+};
+
+
+///
+/// Persistent registry of the metadata of Python plugin source files.
+///
+/// Entries are keyed by source path and validated using modification time, size and content hash.
+/// This allows to get the metadata of unchanged plugins without touching the interpreter. The
+/// content hash is verified if the file was modified shortly before its entry was last validated.
+///
+class MetadataCache
+{
+public:
+
+    using Extractor = std::function<PyPluginMetadata(const QByteArray &source)>;
+
+    /// Constructs the cache and reads the entries persisted in _file_path_, if any.
+    explicit MetadataCache(const std::filesystem::path &file_path);
+
+    /// Returns the metadata of the source file at _source_path_.
+    /// Calls _extract_ on cache misses. Throws if the file can not be read. Thread-safe.
+    PyPluginMetadata metadata(const QString &source_path, const Extractor &extract);
+
+    /// Persists the entries requested since construction. Stale entries are dropped.
+    void save() const;
+
+    /// Returns the number of cache hits since the last reset.
+    uint hits() const;
+
+    /// Returns the number of cache misses since the last reset.
+    uint misses() const;
+
+    /// Resets the hit and miss counters.
+    void resetCounters();
+
+private:
+
+    struct Entry
+    {
+        qint64 mtime;
+        qint64 size;
+        qint64 checked;  // When the content was hashed, ms since epoch
+        QByteArray hash;
+        PyPluginMetadata metadata;
+        bool used;
+    };
+
+    void load();
+
+    const std::filesystem::path file_path_;
+    mutable std::mutex mutex_;
+    std::map<QString, Entry> entries_;
+    uint hits_;
+    uint misses_;
+
+};
@@ -0,0 +1,481 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#include "metadataparser.h"
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+using namespace std;
+
+namespace {
+
+// Thrown on anything the tokenizer does not handle. Caller falls back to a full parse.
+struct Unsupported {};
+
+class Tokenizer
+{
+public:
+
+    explicit Tokenizer(const QByteArray &source) :
+        it_(source.constData()),
+        end_(source.constData() + source.size()) {}
+
+    map<string, MetadataValue> parse()
+    {
+        map<string, MetadataValue> assignments;
+
+        if (string_view(it_, end_ - it_).starts_with("\xEF\xBB\xBF"))  // UTF-8 BOM
+            it_ += 3;
+
+        // Other encodings have to be decoded by the interpreter, which also reports invalid UTF-8
+        if (!isUtf8CodingCookie(codingCookie()) || !isValidUtf8(string_view(it_, end_ - it_)))
+            throw Unsupported{};
+
+        while (!atEnd())
+        {
+            // Only statements starting in the first column are top-level statements
+            if (isIdentifierStart(peek()))
+            {
+                const auto begin = it_;
+                if (const auto name = identifier(); name.starts_with("md_"))
+                {
+                    skipInlineSpace();
+                    if (peek() != '=' || peek(1) == '=')
+                        throw Unsupported{};  // annotations, augmented assignments, etc.
+                    ++it_;
+
+                    skipInlineSpace();
+                    auto v = value();
+
+                    skipInlineSpace();
+                    if (peek() == '#')
+                        skipComment();
+                    if (!atEnd() && *it_++ != '\n')
+                        throw Unsupported{};  // chained, compound statements, etc.
+
+                    assignments.insert_or_assign(string(name), ::move(v));
+                    continue;
+                }
+                it_ = begin;
+                skipStatement(true);
+            }
+            else
+                skipStatement(false);
+        }
+
+        return assignments;
+    }
+
+private:
+
+    const char *it_;
+    const char *const end_;
+
+    bool atEnd() const { return it_ == end_; }
+
+    // PEP 263. The encoding declared in a comment on the first or second line, the latter only if
+    // the first line is a comment or blank. Empty if there is none.
+    string_view codingCookie() const
+    {
+        const string_view source(it_, end_ - it_);
+        size_t line_begin = 0;
+        for (int line = 0; line < 2 && line_begin < source.size(); ++line)
+        {
+            const auto line_end = min(source.find('\n', line_begin), source.size());
+            const auto text = source.substr(line_begin, line_end - line_begin);
+            line_begin = line_end + 1;
+
+            const auto first = text.find_first_not_of(" \t\f\r");
+            if (first == string_view::npos)
+                continue;  // Blank line
+            else if (text[first] != '#')
+                break;
+
+            // Like the regex ^[ \t\f]*#.*?coding[:=][ \t]*([-\w.]+)
+            for (auto pos = text.find("coding", first); pos != string_view::npos;
+                 pos = text.find("coding", pos + 1))
+            {
+                auto begin = pos + 6;
+                if (begin >= text.size() || (text[begin] != ':' && text[begin] != '='))
+                    continue;
+
+                begin = min(text.find_first_not_of(" \t", begin + 1), text.size());
+                auto end = begin;
+                while (end < text.size() && (isalnum(static_cast<unsigned char>(text[end]))
+                                             || text[end] == '-' || text[end] == '_'
+                                             || text[end] == '.'))
+                    ++end;
+                if (end > begin)
+                    return text.substr(begin, end - begin);
+            }
+        }
+        return {};
+    }
+
+    // Like the normalization of the Python tokenizer, e.g. "UTF_8" or "utf-8-unix"
+    static bool isUtf8CodingCookie(string_view cookie)
+    {
+        if (cookie.empty())
+            return true;  // The default
+
+        string name;
+        for (const char c : cookie)
+            name += c == '_' ? '-' : static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        return name == "utf-8" || name == "utf8" || name.starts_with("utf-8-");
+    }
+
+    // Rejects overlong encodings, surrogates and code points beyond U+10FFFF
+    static bool isValidUtf8(string_view s)
+    {
+        for (size_t i = 0; i < s.size();)
+        {
+            const auto c = static_cast<unsigned char>(s[i]);
+            size_t length;
+            unsigned char lo = 0x80, hi = 0xBF;  // Range of the second byte
+            if (c < 0x80)
+                length = 1;
+            else if (c >= 0xC2 && c <= 0xDF)
+                length = 2;
+            else if (c >= 0xE0 && c <= 0xEF)
+            {
+                length = 3;
+                if (c == 0xE0)
+                    lo = 0xA0;
+                else if (c == 0xED)
+                    hi = 0x9F;
+            }
+            else if (c >= 0xF0 && c <= 0xF4)
+            {
+                length = 4;
+                if (c == 0xF0)
+                    lo = 0x90;
+                else if (c == 0xF4)
+                    hi = 0x8F;
+            }
+            else
+                return false;
+
+            if (s.size() - i < length)
+                return false;
+            for (size_t k = 1; k < length; ++k)
+                if (const auto b = static_cast<unsigned char>(s[i + k]);
+                    k == 1 ? (b < lo || b > hi) : (b < 0x80 || b > 0xBF))
+                    return false;
+            i += length;
+        }
+        return true;
+    }
+
+    char peek(ptrdiff_t offset = 0) const { return offset < end_ - it_ ? it_[offset] : '\0'; }
+
+    static bool isIdentifierStart(char c)
+    { return isalpha(static_cast<unsigned char>(c)) || c == '_' || static_cast<unsigned char>(c) >= 0x80; }
+
+    static bool isIdentifierChar(char c)
+    { return isIdentifierStart(c) || isdigit(static_cast<unsigned char>(c)); }
+
+    static bool isQuote(char c) { return c == '"' || c == '\''; }
+
+    string_view identifier()
+    {
+        const auto begin = it_;
+        while (!atEnd() && isIdentifierChar(*it_))
+            ++it_;
+        return {begin, static_cast<size_t>(it_ - begin)};
+    }
+
+    void skipInlineSpace()
+    {
+        while (peek() == ' ' || peek() == '\t' || peek() == '\f' || peek() == '\r')
+            ++it_;
+    }
+
+    // Whitespace, newlines, comments and explicit line continuations. Valid in brackets only.
+    void skipSpace()
+    {
+        while (!atEnd())
+        {
+            if (const char c = *it_; c == ' ' || c == '\t' || c == '\f' || c == '\r' || c == '\n')
+                ++it_;
+            else if (c == '#')
+                skipComment();
+            else if (c == '\\' && (peek(1) == '\n' || (peek(1) == '\r' && peek(2) == '\n')))
+                it_ += peek(1) == '\n' ? 2 : 3;
+            else
+                break;
+        }
+    }
+
+    void skipComment()
+    {
+        while (!atEnd() && *it_ != '\n')
+            ++it_;
+    }
+
+    void skipString()
+    {
+        const char q = *it_;
+        const bool triple = peek(1) == q && peek(2) == q;
+        it_ += triple ? 3 : 1;
+
+        while (true)
+        {
+            if (atEnd())
+                throw Unsupported{};  // Unterminated. Let the full parse report it.
+            else if (const char c = *it_; c == '\\')
+                it_ += peek(1) == '\0' ? 1 : 2;
+            else if (!triple && c == '\n')
+                throw Unsupported{};
+            else if (c == q && (!triple || (peek(1) == q && peek(2) == q)))
+            {
+                it_ += triple ? 3 : 1;
+                return;
+            }
+            else
+                ++it_;
+        }
+    }
+
+    // Skips a logical line. Throws if a top-level statement references md_* names.
+    void skipStatement(bool top_level)
+    {
+        int depth = 0;
+        while (!atEnd())
+        {
+            if (const char c = *it_; c == '\n')
+            {
+                ++it_;
+                if (depth == 0)
+                    return;
+            }
+            else if (c == '#')
+                skipComment();
+            else if (c == '\\')
+            {
+                ++it_;
+                if (peek() == '\r')
+                    ++it_;
+                if (!atEnd())
+                    ++it_;
+            }
+            else if (isQuote(c))
+                skipString();
+            else if (c == '(' || c == '[' || c == '{')
+            {
+                ++depth;
+                ++it_;
+            }
+            else if (c == ')' || c == ']' || c == '}')
+            {
+                if (depth > 0)
+                    --depth;
+                ++it_;
+            }
+            else if (isdigit(static_cast<unsigned char>(c)))
+                while (!atEnd() && isIdentifierChar(*it_))
+                    ++it_;
+            else if (isIdentifierStart(c))
+            {
+                if (identifier().starts_with("md_") && top_level)
+                    throw Unsupported{};
+            }
+            else
+                ++it_;
+        }
+    }
+
+    bool atStringStart() const
+    {
+        for (ptrdiff_t i = 0; i < 3; ++i)
+            if (isQuote(peek(i)))
+                return true;
+            else if (!isalpha(static_cast<unsigned char>(peek(i))))
+                return false;
+        return false;
+    }
+
+    static void appendUtf8(string &buffer, char32_t cp)
+    {
+        if (cp < 0x80)
+            buffer += static_cast<char>(cp);
+        else if (cp < 0x800)
+        {
+            buffer += static_cast<char>(0xC0 | (cp >> 6));
+            buffer += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000)
+        {
+            buffer += static_cast<char>(0xE0 | (cp >> 12));
+            buffer += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            buffer += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else
+        {
+            buffer += static_cast<char>(0xF0 | (cp >> 18));
+            buffer += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            buffer += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            buffer += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    char32_t hex(int digits)
+    {
+        char32_t cp = 0;
+        for (int i = 0; i < digits; ++i, ++it_)
+        {
+            if (const char c = peek(); c >= '0' && c <= '9')
+                cp = cp * 16 + (c - '0');
+            else if (c >= 'a' && c <= 'f')
+                cp = cp * 16 + (c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F')
+                cp = cp * 16 + (c - 'A' + 10);
+            else
+                throw Unsupported{};
+        }
+        if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+            throw Unsupported{};  // Not representable in QString as is
+        return cp;
+    }
+
+    void escape(string &buffer)
+    {
+        if (atEnd())
+            throw Unsupported{};
+
+        switch (const char c = *it_++; c)
+        {
+        case '\n': return;  // Line continuation
+        case '\r': if (peek() == '\n') ++it_; return;
+        case '\\': buffer += '\\'; return;
+        case '\'': buffer += '\''; return;
+        case '"':  buffer += '"';  return;
+        case 'a':  buffer += '\a'; return;
+        case 'b':  buffer += '\b'; return;
+        case 'f':  buffer += '\f'; return;
+        case 'n':  buffer += '\n'; return;
+        case 'r':  buffer += '\r'; return;
+        case 't':  buffer += '\t'; return;
+        case 'v':  buffer += '\v'; return;
+        case 'x':  appendUtf8(buffer, hex(2)); return;
+        case 'u':  appendUtf8(buffer, hex(4)); return;
+        case 'U':  appendUtf8(buffer, hex(8)); return;
+        case 'N':  throw Unsupported{};  // Named unicode characters require the unicode database
+        default:
+            if (c >= '0' && c <= '7')
+            {
+                char32_t cp = c - '0';
+                for (int i = 0; i < 2 && peek() >= '0' && peek() <= '7'; ++i)
+                    cp = cp * 8 + (*it_++ - '0');
+                appendUtf8(buffer, cp);
+            }
+            else  // Python keeps unrecognized escape sequences
+            {
+                buffer += '\\';
+                buffer += c;
+            }
+        }
+    }
+
+    QString literal()
+    {
+        bool raw = false;
+        for (; isalpha(static_cast<unsigned char>(peek())); ++it_)
+            if (peek() == 'r' || peek() == 'R')
+                raw = true;
+            else if (peek() != 'u' && peek() != 'U')
+                throw Unsupported{};  // bytes, f-strings, template strings
+
+        const char q = peek();
+        if (!isQuote(q))
+            throw Unsupported{};
+        const bool triple = peek(1) == q && peek(2) == q;
+        it_ += triple ? 3 : 1;
+
+        string buffer;
+        while (true)
+        {
+            if (atEnd())
+                throw Unsupported{};
+            else if (const char c = *it_; !triple && c == '\n')
+                throw Unsupported{};
+            else if (c == q && (!triple || (peek(1) == q && peek(2) == q)))
+            {
+                it_ += triple ? 3 : 1;
+                return QString::fromUtf8(buffer);
+            }
+            else if (c == '\\' && raw)
+            {
+                buffer += *it_++;
+                if (!atEnd())
+                    buffer += *it_++;
+            }
+            else if (c == '\\')
+            {
+                ++it_;
+                escape(buffer);
+            }
+            else if (c == '\r' && peek(1) == '\n')  // Python normalizes newlines
+                ++it_;
+            else
+                buffer += *it_++;
+        }
+    }
+
+    // Implicitly concatenated string literals
+    QString literals(bool in_brackets)
+    {
+        QString s = literal();
+        while (true)
+        {
+            if (in_brackets)
+                skipSpace();
+            else
+                skipInlineSpace();
+
+            if (atStringStart())
+                s += literal();
+            else
+                return s;
+        }
+    }
+
+    QStringList list()
+    {
+        QStringList list;
+        ++it_;  // [
+        skipSpace();
+        while (peek() != ']')
+        {
+            list << literals(true);
+            skipSpace();
+            if (peek() == ',')
+            {
+                ++it_;
+                skipSpace();
+            }
+            else if (peek() != ']')
+                throw Unsupported{};
+        }
+        ++it_;  // ]
+        return list;
+    }
+
+    MetadataValue value()
+    {
+        if (peek() == '[')
+            return list();
+        else
+            return literals(false);
+    }
+
+};
+
+}
+
+optional<map<string, MetadataValue>> parseMetadataAssignments(const QByteArray &source)
+{
+    try {
+        return Tokenizer(source).parse();
+    } catch (const Unsupported &) {
+        return nullopt;
+    }
+}
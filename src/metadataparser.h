@@ -0,0 +1,24 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#pragma once
+#include <QByteArray>
+#include <QStringList>
+#include <map>
+#include <optional>
+#include <string>
+#include <variant>
+
+using MetadataValue = std::variant<QString, QStringList>;
+
+///
+/// Extracts the top-level `md_* = "…"` and `md_* = ["…", …]` assignments of Python source code.
+///
+/// This is a minimal tokenizer that does not require the interpreter (and hence not the GIL).
+/// Returns the assignments keyed by name, i.e. sorted by name. Later assignments of a name
+/// override former ones.
+/// Returns std::nullopt if the source contains constructs involving `md_*` names that can not be
+/// handled natively, e.g. annotated or chained assignments or non-literal values, declares an
+/// encoding other than UTF-8 (PEP 263) or is not valid UTF-8. In this case the caller should fall
+/// back to a full parse.
+///
+std::optional<std::map<std::string, MetadataValue>> parseMetadataAssignments(const QByteArray &source);
@@ -1,14 +1,25 @@
 // Copyright (c) 2022-2025 Manuel Schneider
 
 #include "cast_specialization.hpp"
+#include "asyncioloop.h"
 #include "embeddedmodule.hpp"
+#include "gcpolicy.h"
 // import pybind first
 
+#include "loadscheduler.h"
+#include "metadatacache.h"
 #include "plugin.h"
 #include "pypluginloader.h"
+#include "queryscope.h"
+#include "requirements.h"
+#include "subinterpreters.h"
 #include "ui_configwidget.h"
+#include <QCryptographicHash>
 #include <QDir>
+#include <QDirIterator>
 #include <QFile>
+#include <QFileDialog>
+#include <QFileSystemWatcher>
 #include <QFontDatabase>
 #include <QJsonArray>
 #include <QJsonDocument>
@@ -17,13 +28,21 @@
 #include <QProcess>
 #include <QRegularExpression>
 #include <QSettings>
+#include <QSpinBox>
+#include <QStandardPaths>
 #include <QTextEdit>
+#include <QThreadPool>
+#include <QTimer>
 #include <QUrl>
+#include <QtEndian>
+#include <QtConcurrentMap>
 #include <QtConcurrentRun>
 #include <albert/logging.h>
 #include <albert/messagebox.h>
 #include <albert/systemutil.h>
 #include <chrono>
+#include <future>
+#include <thread>
 ALBERT_LOGGING_CATEGORY("python")
 using namespace Qt::StringLiterals;
 using namespace albert;
@@ -33,6 +52,11 @@ using std::filesystem::path;
 namespace py = pybind11;
 #define XSTR(s) STR(s)
 #define STR(s) #s
+#ifdef Py_GIL_DISABLED
+#define ABI_THREAD "t"  // Free-threaded build, e.g. python3.13t
+#else
+#define ABI_THREAD ""
+#endif
 
 applications::Plugin *apps;  // used externally
 
@@ -41,13 +65,25 @@ namespace {
 const auto& BIN = "bin";
 const auto& STUB_VERSION = "stub_version";
 const auto& LIB = "lib";
+const auto& LOAD_STATISTICS = "load_statistics.json";
+const auto& IMPORT_PROFILES = "import_profiles";
+const auto& METADATA_CACHE = "plugin_metadata.json";
 const auto& PIP = "pip" XSTR(PY_MAJOR_VERSION) "." XSTR(PY_MINOR_VERSION);
 const auto& PLUGINS = "plugins";
-const auto& PYTHON = "python" XSTR(PY_MAJOR_VERSION) "." XSTR(PY_MINOR_VERSION);
+const auto& PYCACHE = "pycache";
+const auto& PYTHON = "python" XSTR(PY_MAJOR_VERSION) "." XSTR(PY_MINOR_VERSION) ABI_THREAD;
+const auto& PYTHON_VERSION = PY_VERSION ABI_THREAD;
 const auto& SITE_PACKAGES = "site-packages";
+const auto& STARTUP_TRACE = "startup_trace.json";
 const auto& STUB_FILE = "albert.pyi";
 const auto& VENV = "venv";
+const auto& WHEELHOUSE = "wheelhouse";
 const auto& sk_venv_python_version = "venv_python_version";
+const auto& sk_interrupt_cancelled = "interrupt_cancelled_queries";
+const auto& sk_profile_imports = "profile_imports";
+const auto& sk_pull_budget = "pull_budget_ms";
+const auto& sk_snapshot_items = "snapshot_items";
+const auto& sk_subinterpreters = "subinterpreters";
 const auto& red = "\x1b[31m";
 const auto& reset = "\x1b[0m";
 const auto& cyan = "\x1b[36m";
@@ -91,7 +127,7 @@ const auto& cyan = "\x1b[36m";
 //         DEBG << " -" << path;
 // }
 
-static QString run(const QString program, const QStringList args)
+static QString run(const QString program, const QStringList args, bool warn = true)
 {
     const auto cmdline = (QStringList(program) + args).join(QChar::Space);
 
@@ -102,23 +138,28 @@ static QString run(const QString program, const QStringList args)
     if (!p.waitForFinished())
     {
         const auto msg = QT_TRANSLATE_NOOP("Plugin", "'%1' timed out (30s).");
-        WARN << QString::fromUtf8(msg).arg(cmdline);
+        if (warn)
+            WARN << QString::fromUtf8(msg).arg(cmdline);
         throw runtime_error(Plugin::tr(msg).arg(cmdline).toStdString());
     }
     else if (p.exitStatus() != QProcess::ExitStatus::NormalExit)
     {
         const auto msg = QT_TRANSLATE_NOOP("Plugin", "'%1' crashed.");
-        WARN << QString::fromUtf8(msg).arg(cmdline);
+        if (warn)
+            WARN << QString::fromUtf8(msg).arg(cmdline);
         throw runtime_error(Plugin::tr(msg).arg(cmdline).toStdString());
     }
     else if (p.exitCode() != EXIT_SUCCESS)
     {
         const auto msg = QT_TRANSLATE_NOOP("Plugin", "'%1' finished with exit code: %2.");
-        WARN << QString::fromUtf8(msg).arg(cmdline).arg(p.exitCode());
-        if (const auto stdout = p.readAllStandardOutput(); !stdout.isEmpty())
-            WARN << cyan << stdout << reset;
-        if (const auto stderr = p.readAllStandardError(); !stderr.isEmpty())
-            WARN << red << stderr << reset;
+        if (warn)
+        {
+            WARN << QString::fromUtf8(msg).arg(cmdline).arg(p.exitCode());
+            if (const auto stdout = p.readAllStandardOutput(); !stdout.isEmpty())
+                WARN << cyan << stdout << reset;
+            if (const auto stderr = p.readAllStandardError(); !stderr.isEmpty())
+                WARN << red << stderr << reset;
+        }
         throw runtime_error(Plugin::tr(msg).arg(cmdline).arg(p.exitCode()).toStdString());
     }
     else
@@ -130,7 +171,7 @@ Plugin::Plugin()
 {
     ::apps = apps.get();
 
-    DEBG << "Python version:" << PY_VERSION;
+    DEBG << "Python version:" << PYTHON_VERSION;
     DEBG << "Pybind11 version:" << u"%1.%2.%3"_s
                                        .arg(PYBIND11_VERSION_MAJOR)
                                        .arg(PYBIND11_VERSION_MINOR)
@@ -138,13 +179,39 @@ Plugin::Plugin()
 
     filesystem::create_directories(dataLocation() / PLUGINS);
 
+    metadata_cache_ = make_unique<MetadataCache>(metadataCachePath());
+    load_scheduler_ = make_unique<LoadScheduler>(loadStatisticsPath());
+    gc_policy_ = make_unique<GcPolicy>();
+    profile_imports_ = settings()->value(sk_profile_imports, false).toBool();
+    ItemSnapshot::enabled = settings()->value(sk_snapshot_items, false).toBool();
+    ItemGeneratorWrapper::pull_budget_ms =
+        settings()->value(sk_pull_budget, ItemGeneratorWrapper::pull_budget_ms.load()).toInt();
+    QueryScope::interrupt_cancelled = settings()->value(sk_interrupt_cancelled, false).toBool();
+    subinterpreters_ = Subinterpreters::isSupported()
+                       && settings()->value(sk_subinterpreters, false).toBool();
+    if (subinterpreters_)
+        INFO << "Running plugins in subinterpreters.";
+
+    auto span = startup_trace_.span(u"Interpreter initialization"_s, u"python"_s);
     initPythonInterpreter();
 }
 
 Plugin::~Plugin()
 {
+    // Precompilation acquires the GIL. Finish before the GIL is taken back.
+    stop_precompilation_ = true;
+    precompilation_.waitForFinished();
+
+    // The venv setup and the imports acquire the GIL too
+    if (venv_ready_.valid())
+        venv_ready_.wait();
+    load_scheduler_->waitForFinished();
+    gc_policy_.reset();
+    AsyncioLoop::stop();
+
     release_.reset();
     loaders_.clear();
+    Subinterpreters::clear();
 
     // Causes hard to debug crashes, mem leaked, but nobody will toggle it a lot
     // py::finalize_interpreter();
@@ -152,21 +219,64 @@ Plugin::~Plugin()
 
 void Plugin::initialize()
 {
-    QtConcurrent::run([this] -> shared_ptr<vector<unique_ptr<PyPluginLoader>>> {
-        initVirtualEnvironment();
+    auto venv_promise = make_shared<promise<void>>();
+    venv_ready_ = venv_promise->get_future().share();
+    auto init_venv = [this, venv_promise] {
+        try {
+            const auto t = system_clock::now();
+            auto span = startup_trace_.span(u"Virtual environment"_s, u"venv"_s);
+            initVirtualEnvironment();
+            INFO << u"[%1 ms] Virtual environment ready."_s
+                        .arg(duration_cast<milliseconds>(system_clock::now() - t).count());
+            venv_promise->set_value();
+        } catch (const exception &e) {
+            CRIT << "Failed initializing the virtual environment:" << e.what();
+            venv_promise->set_exception(current_exception());
+        } catch (...) {
+            CRIT << "Unknown exception while initializing the virtual environment.";
+            venv_promise->set_exception(current_exception());
+        }
+    };
+
+    // An existing venv only adds its site dir to the path. Do this before the scan, such that
+    // loads of plugins importing packages of the venv without declaring them do not race it.
+    // Creating a venv takes seconds and is only required by plugins having lib dependencies.
+    // Create it in parallel to the scan and let the loads of these plugins wait for it (see
+    // waitForVirtualEnvironment). Started first such that loads waiting for it can not starve it
+    // of pool threads.
+    if (is_directory(venvPath())
+        && state()->value(sk_venv_python_version).toString() == QString::fromLatin1(PYTHON_VERSION))
+        init_venv();
+    else
+        QtConcurrent::run(init_venv);
+
+    QtConcurrent::run([this] {
+        auto span = startup_trace_.span(u"Stub file update"_s, u"startup"_s);
         updateStubFile();
+    });
 
-        // Set loader thread affinity to main thread
+    QtConcurrent::run([this] -> shared_ptr<vector<unique_ptr<PyPluginLoader>>> {
+        // Loaders thread affinity is set to the main thread by the scan
+        auto span = startup_trace_.span(u"Plugin scan"_s, u"scan"_s);
         auto loaders = scanPlugins();
-        for (auto &loader : loaders)
-            loader->moveToThread(this->thread());
 
         // Make copyable for missing qtconcurrent move semantics
         return make_shared<vector<unique_ptr<PyPluginLoader>>>(::move(loaders));
     })
     .then(this, [this](shared_ptr<vector<unique_ptr<PyPluginLoader>>> loaders) {
+        // Publish without waiting for the venv
+        auto span = startup_trace_.span(u"Publish loaders"_s, u"startup"_s,
+                                        {{u"plugins"_s, static_cast<int>(loaders->size())}});
         loaders_ = ::move(*loaders);
         PluginInstance::initialize();
+
+        // Compile the bytecode of all plugins in the background
+        vector<pair<QString, QString>> plugins;
+        for (const auto &loader : loaders_)
+            plugins.emplace_back(loader->metadata().id, loader->path());
+        precompilation_ = QtConcurrent::run([this, plugins] { precompilePlugins(plugins); });
+
+        watchPlugins();
     })
     .onCanceled(this, [] {
         WARN << "Cancelled plugin initialization.";
@@ -185,6 +295,16 @@ void Plugin::initialize()
     });
 }
 
+void Plugin::waitForVirtualEnvironment() const
+{
+    try {
+        venv_ready_.get();
+    } catch (const exception &e) {
+        throw runtime_error(tr("Virtual environment not available: %1")
+                                .arg(QString::fromUtf8(e.what())).toStdString());
+    }
+}
+
 void Plugin::updateStubFile() const
 {
     QFile stub_rc(u":"_s + QString::fromLatin1(STUB_FILE));
@@ -214,23 +334,40 @@ void Plugin::initPythonInterpreter()
     PyConfig config;
     PyConfig_InitIsolatedConfig(&config);
     config.site_import = 0;
+
+    // Keep bytecode in the cache location. Plugin dirs may be read-only, e.g. system-wide installs.
+    if (auto status = PyConfig_SetBytesString(&config, &config.pycache_prefix,
+                                              pycachePrefixPath().c_str());
+        PyStatus_Exception(status))
+        throw runtime_error(format("Failed setting pycache prefix: {} {}",
+                                   status.func, status.err_msg));
+
     // dumpPyConfig(config);
     if (auto status = Py_InitializeFromConfig(&config); PyStatus_Exception(status))
         throw runtime_error(format("Failed initializing the interpreter: {} {}",
                                    status.func, status.err_msg));
     PyConfig_Clear(&config);
 
+#ifdef Py_GIL_DISABLED
+    // Extension modules not declaring free-threading support re-enable the GIL on import
+    py::module::import("albert");
+    if (py::module::import("sys").attr("_is_gil_enabled")().cast<bool>())
+        WARN << "Free-threaded interpreter, but the GIL is enabled.";
+    else
+        INFO << "Free-threaded interpreter. Python code runs in parallel.";
+#endif
+
+    GcPolicy::instrument();
+
     // Gil is initially held. We want it to be released by default.
     release_.reset(new py::gil_scoped_release);
 }
 
 void Plugin::initVirtualEnvironment() const
 {
-    py::gil_scoped_acquire acquire;
-
     // Reset venv if python version changed
     if (is_directory(venvPath())
-        && (state()->value(sk_venv_python_version).toString() != QString::fromLatin1(PY_VERSION)))
+        && (state()->value(sk_venv_python_version).toString() != QString::fromLatin1(PYTHON_VERSION)))
     {
         INFO << "Python version changed. Resetting virtual environment.";
         QFile::moveToTrash(venvPath());
@@ -238,10 +375,15 @@ void Plugin::initVirtualEnvironment() const
 
     if (!is_directory(venvPath()))
     {
-        auto system_python = py::module::import("sys").attr("prefix").cast<path>() / BIN / PYTHON;
+        path system_python;
+        {
+            py::gil_scoped_acquire acquire;
+            system_python = py::module::import("sys").attr("prefix").cast<path>() / BIN / PYTHON;
+        }
 
         DEBG << "Initializing venv using system interpreter" << system_python;
 
+        // Do not hold the GIL here. Plugins not depending on the venv load meanwhile.
         const auto stdout = run(QString::fromLocal8Bit(system_python.native()),
                                 {u"-m"_s,
                                  u"venv"_s,
@@ -252,10 +394,11 @@ void Plugin::initVirtualEnvironment() const
         if (!stdout.isEmpty())
             DEBG << stdout;
 
-        state()->setValue(sk_venv_python_version, QString::fromLatin1(PY_VERSION));
+        state()->setValue(sk_venv_python_version, QString::fromLatin1(PYTHON_VERSION));
     }
 
     // Add venv site packages to path
+    py::gil_scoped_acquire acquire;
     py::module::import("site").attr("addsitedir")(siteDirPath().c_str());
 }
 
@@ -267,38 +410,383 @@ path Plugin::userPluginDirectoryPath() const { return dataLocation() / PLUGINS;
 
 path Plugin::stubFilePath() const { return userPluginDirectoryPath() / STUB_FILE; }
 
+path Plugin::metadataCachePath() const { return cacheLocation() / METADATA_CACHE; }
+
+path Plugin::loadStatisticsPath() const { return cacheLocation() / LOAD_STATISTICS; }
+
+path Plugin::wheelhousePath() const { return cacheLocation() / WHEELHOUSE; }
+
+path Plugin::pycachePrefixPath() const { return cacheLocation() / PYCACHE; }
+
+path Plugin::importProfilesPath() const { return cacheLocation() / IMPORT_PROFILES; }
+
+path Plugin::importProfilePath(const QString &plugin_id) const
+{ return importProfilesPath() / (plugin_id + u".txt"_s).toStdString(); }
+
+PyInterpreterState *Plugin::pluginInterpreter(const QString &plugin_id) const
+{
+    if (!subinterpreters_)
+        return nullptr;
+
+    return Subinterpreters::get(plugin_id, [this]
+    {
+        GcPolicy::instrument();
+
+        // The venv is ready for all plugins that need it, see waitForVirtualEnvironment
+        if (venv_ready_.wait_for(0s) == future_status::ready && is_directory(siteDirPath()))
+            py::module::import("site").attr("addsitedir")(siteDirPath().c_str());
+    });
+}
+
+bool Plugin::isImportProfilingEnabled() const { return profile_imports_; }
+
+void Plugin::setImportProfilingEnabled(bool enabled)
+{
+    profile_imports_ = enabled;
+    settings()->setValue(sk_profile_imports, enabled);
+}
+
+MetadataCache &Plugin::metadataCache() const { return *metadata_cache_; }
+
+StartupTrace &Plugin::startupTrace() const { return startup_trace_; }
+
+LoadScheduler &Plugin::loadScheduler() const { return *load_scheduler_; }
+
+GcPolicy &Plugin::gcPolicy() const { return *gc_policy_; }
+
+// Entries of a plugin directory, i.e. candidate plugin modules and packages
+static QStringList pluginEntries(const QDir &dir)
+{
+    QStringList entries;
+    for (const auto r = dir.entryInfoList(QDir::Files|QDir::Dirs|QDir::NoDotAndDotDot);
+         const QFileInfo &file_info : r)
+        entries << file_info.absoluteFilePath();
+    return entries;
+}
+
 vector<unique_ptr<PyPluginLoader>> Plugin::scanPlugins() const
 {
     auto start = system_clock::now();
 
-    vector<unique_ptr<PyPluginLoader>> plugins;
+    metadata_cache_->resetCounters();
+
+    // List the entries of all plugin directories
+
+    struct Entry {
+        QString path;
+        unique_ptr<PyPluginLoader> loader;
+    };
+
+    vector<Entry> entries;
     for (const auto &data_location : dataLocations())
     {
         if (QDir dir{data_location/PLUGINS}; dir.exists())
         {
             DEBG << "Searching Python plugins in" << dir.absolutePath();
-            for (const auto r = dir.entryInfoList(QDir::Files|QDir::Dirs|QDir::NoDotAndDotDot);
-                 const QFileInfo &file_info : r)
+            for (const auto &entry : pluginEntries(dir))
+                entries.emplace_back(entry, nullptr);
+        }
+    }
+
+    auto tp_list = system_clock::now();
+
+    // Construct the loaders concurrently. Metadata extraction does not require the GIL.
+    // Loaders are created on pool threads. Move them to the thread of this plugin right away.
+
+    QtConcurrent::blockingMap(entries, [this, thread = this->thread()](Entry &entry)
+    {
+        auto span = startup_trace_.span(u"Scan entry"_s, u"scan"_s, {{u"path"_s, entry.path}});
+        try {
+            entry.loader = make_unique<PyPluginLoader>(*this, entry.path);
+            entry.loader->moveToThread(thread);
+        }
+        catch (const NoPluginException &e) {
+            DEBG << "Invalid plugin" << entry.path << e.what();
+        }
+        catch (const exception &e) {
+            WARN << e.what() << entry.path;
+        }
+    });
+
+    auto tp_load = system_clock::now();
+
+    // Merge in order of data locations and directory entries
+
+    vector<unique_ptr<PyPluginLoader>> plugins;
+    for (auto &entry : entries)
+        if (entry.loader)
+        {
+            DEBG << "Found valid Python plugin" << entry.loader->path();
+            plugins.emplace_back(::move(entry.loader));
+        }
+
+    metadata_cache_->save();
+
+    auto tp_merge = system_clock::now();
+
+    INFO << u"[%1 ms] Python plugin scan (list: %2 ms, load: %3 ms, merge: %4 ms, "
+            "%5 entries, %6 threads, metadata cache: %7 hits, %8 misses)"_s
+                .arg(duration_cast<milliseconds>(tp_merge - start).count())
+                .arg(duration_cast<milliseconds>(tp_list - start).count())
+                .arg(duration_cast<milliseconds>(tp_load - tp_list).count())
+                .arg(duration_cast<milliseconds>(tp_merge - tp_load).count())
+                .arg(entries.size())
+                .arg(QThreadPool::globalInstance()->maxThreadCount())
+                .arg(metadata_cache_->hits())
+                .arg(metadata_cache_->misses());
+
+    return plugins;
+}
+
+// Python source files of a plugin module or package
+static QStringList pythonSources(const QString &module_path)
+{
+    QStringList sources;
+    if (QFileInfo(module_path).isFile())
+        sources << module_path;
+    else
+        for (QDirIterator it(module_path, {u"*.py"_s}, QDir::Files, QDirIterator::Subdirectories);
+             it.hasNext();)
+            if (auto source = it.next(); !source.contains(u"/__pycache__/"_s)
+                                         && !source.contains(u"/."_s))
+                sources << source;
+    return sources;
+}
+
+// Same as importlib.util.cache_from_source with sys.pycache_prefix set
+static QString bytecodePath(const path &prefix, const QString &source, const QString &cache_tag)
+{
+    const QFileInfo fi(source);
+    auto head = fi.absolutePath();
+
+    // Strip the drive of Windows paths, then the root to get a root-relative path
+    if (head.size() > 1 && head[1] == u':' && head[0] != u'/' && head[0] != u'\\')
+        head = head.mid(2);
+    while (head.startsWith(u'/') || head.startsWith(u'\\'))
+        head = head.mid(1);
+
+    return QDir(toQString(prefix))
+        .filePath(u"%1/%2.%3.pyc"_s.arg(head, fi.completeBaseName(), cache_tag));
+}
+
+// Checks the header of pyc files (PEP 552). Hash based pycs are checked against the source hash
+// regardless of their check_source flag.
+static bool isBytecodeUpToDate(const QString &bytecode, const QString &source, const QByteArray &magic)
+{
+    QFile file(bytecode);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const auto header = file.read(16);
+    if (header.size() != 16 || !header.startsWith(magic))
+        return false;
+
+    const auto *h = reinterpret_cast<const uchar*>(header.constData());
+    if (const auto flags = qFromLittleEndian<quint32>(h + 4); flags == 0)  // Timestamp based
+    {
+        const QFileInfo fi(source);
+        return qFromLittleEndian<quint32>(h + 8) == quint32(fi.lastModified().toSecsSinceEpoch())
+               && qFromLittleEndian<quint32>(h + 12) == quint32(fi.size());
+    }
+    else if (flags == 0b01 || flags == 0b11)  // Hash based, unchecked or checked
+    {
+        QFile source_file(source);
+        if (!source_file.open(QIODevice::ReadOnly))
+            return false;
+        const auto data = source_file.readAll();
+
+        try {
+            py::gil_scoped_acquire acquire;
+            const auto hash = py::module::import("importlib.util").attr("source_hash")(
+                py::bytes(data.constData(), data.size())).cast<string>();
+            return header.sliced(8) == QByteArray::fromStdString(hash);
+        } catch (const exception &) {
+            return false;
+        }
+    }
+    else
+        return false;
+}
+
+void Plugin::precompilePlugins(const vector<pair<QString, QString>> &plugins) const
+{
+    auto span = startup_trace_.span(u"Bytecode precompilation"_s, u"python"_s);
+    try {
+        auto start = system_clock::now();
+
+        QByteArray magic;
+        QString cache_tag;
+        {
+            py::gil_scoped_acquire acquire;
+            magic = QByteArray::fromStdString(
+                py::module::import("importlib.util").attr("MAGIC_NUMBER").cast<string>());
+            cache_tag = py::module::import("sys").attr("implementation").attr("cache_tag").cast<QString>();
+        }
+
+        uint total_files = 0;
+        uint total_hits = 0;
+        for (const auto &[id, module_path] : plugins)
+        {
+            auto tp = system_clock::now();
+            uint files = 0;
+            uint hits = 0;
+
+            for (const auto &source : pythonSources(module_path))
             {
-                try {
-                    auto loader = make_unique<PyPluginLoader>(*this, file_info.absoluteFilePath());
-                    DEBG << "Found valid Python plugin" << loader->path();
-                    plugins.emplace_back(::move(loader));
-                }
-                catch (const NoPluginException &e) {
-                    DEBG << "Invalid plugin" << file_info.filePath() << e.what();
-                }
-                catch (const exception &e) {
-                    WARN << e.what() << file_info.filePath();
-                }
+                if (stop_precompilation_)
+                    return;
+
+                ++files;
+                const auto bytecode = bytecodePath(pycachePrefixPath(), source, cache_tag);
+                if (isBytecodeUpToDate(bytecode, source, magic))
+                    ++hits;
+                else
+                    try {
+                        py::gil_scoped_acquire acquire;
+                        // Timestamp based, the default unless SOURCE_DATE_EPOCH is set. Checking
+                        // these does not need the GIL.
+                        const auto py_compile = py::module::import("py_compile");
+                        py_compile.attr("compile")(
+                            source, py::arg("cfile") = bytecode, py::arg("doraise") = true,
+                            py::arg("invalidation_mode")
+                                = py_compile.attr("PycInvalidationMode").attr("TIMESTAMP"));
+                    } catch (const exception &e) {
+                        DEBG << id << "Failed compiling" << source << e.what();
+                    }
             }
+
+            DEBG << u"%1: Bytecode precompiled in %2 ms (%3/%4 cached)"_s
+                        .arg(id)
+                        .arg(duration_cast<milliseconds>(system_clock::now() - tp).count())
+                        .arg(hits).arg(files);
+
+            total_files += files;
+            total_hits += hits;
         }
+
+        INFO << u"[%1 ms] Python plugin precompilation (%2/%3 cached)"_s
+                    .arg(duration_cast<milliseconds>(system_clock::now() - start).count())
+                    .arg(total_hits).arg(total_files);
+    }
+    catch (const exception &e) {
+        WARN << "Failed precompiling plugins:" << e.what();
     }
+}
 
-    INFO << u"[%1 ms] Python plugin scan"_s
-                .arg(duration_cast<milliseconds>(system_clock::now()-start).count());
+// Changes if a Python source of the module is added, removed or modified
+static QByteArray sourceStamp(const QString &module_path)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (const auto &source : pythonSources(module_path))
+    {
+        const QFileInfo fi(source);
+        hash.addData(source.toUtf8());
+        hash.addData(QByteArray::number(fi.lastModified().toMSecsSinceEpoch()));
+        hash.addData(QByteArray::number(fi.size()));
+    }
+    return hash.result();
+}
 
-    return plugins;
+void Plugin::watchPlugins()
+{
+    if (!plugin_watcher_)
+    {
+        plugin_watcher_ = make_unique<QFileSystemWatcher>();
+
+        // Debounce bursts of events, e.g. editors saving or checkouts
+        rescan_timer_.setSingleShot(true);
+        rescan_timer_.setInterval(500ms);
+        connect(&rescan_timer_, &QTimer::timeout, this, &Plugin::rescanPlugins);
+        connect(plugin_watcher_.get(), &QFileSystemWatcher::directoryChanged,
+                &rescan_timer_, qOverload<>(&QTimer::start));
+        connect(plugin_watcher_.get(), &QFileSystemWatcher::fileChanged,
+                &rescan_timer_, qOverload<>(&QTimer::start));
+    }
+
+    // Plugin directories for added and removed plugins, package directories for added and
+    // removed sources, the sources for in place modifications
+    QStringList paths;
+    for (const auto &data_location : dataLocations())
+        if (QDir dir{data_location/PLUGINS}; dir.exists())
+        {
+            paths << dir.absolutePath();
+            for (const auto &entry : pluginEntries(dir))
+            {
+                if (!source_stamps_.contains(entry))
+                    source_stamps_.emplace(entry, sourceStamp(entry));
+
+                paths << entry << pythonSources(entry);
+                if (QFileInfo(entry).isDir())
+                    for (QDirIterator it(entry, QDir::Dirs|QDir::NoDotAndDotDot,
+                                         QDirIterator::Subdirectories); it.hasNext();)
+                        if (auto sub_dir = it.next(); !sub_dir.contains(u"/__pycache__"_s)
+                                                      && !sub_dir.contains(u"/."_s))
+                            paths << sub_dir;
+            }
+        }
+
+    // Files replaced by editors drop out of the watcher. Add what is missing.
+    const auto watched = plugin_watcher_->files() + plugin_watcher_->directories();
+    paths.removeDuplicates();
+    paths.removeIf([&](const QString &p) { return watched.contains(p); });
+    if (!paths.isEmpty())
+        plugin_watcher_->addPaths(paths);
+}
+
+void Plugin::rescanPlugins()
+{
+    const auto start = system_clock::now();
+
+    QStringList changed;
+    for (auto &[entry, stamp] : source_stamps_)
+        if (auto current = sourceStamp(entry); current != stamp)
+        {
+            stamp = current;
+            changed << entry;
+        }
+
+    for (const auto &data_location : dataLocations())
+        for (const auto &entry : pluginEntries(QDir(data_location/PLUGINS)))
+            if (!source_stamps_.contains(entry))
+            {
+                source_stamps_.emplace(entry, sourceStamp(entry));
+                changed << entry;
+            }
+
+    // The core is not notified about changes of plugins(). New plugins are loaded on restart.
+    for (const auto &entry : as_const(changed))
+    {
+        auto it = ranges::find(loaders_, entry, &PyPluginLoader::path);
+
+        if (it == loaders_.end())
+        {
+            if (!QFileInfo::exists(entry))
+                source_stamps_.erase(entry);
+            else
+                INFO << u"New plugin found. Restart to load it (%1)"_s.arg(entry);
+        }
+        else if (!QFileInfo::exists(entry))
+        {
+            source_stamps_.erase(entry);
+            INFO << u"%1: Plugin removed. Restart to unload it."_s.arg((*it)->metadata().id);
+        }
+        else if ((*it)->reload())
+            INFO << u"%1: Sources changed. The next load uses the new sources."_s
+                        .arg((*it)->metadata().id);
+        else
+            INFO << u"%1: Sources changed. Disable and enable the plugin to apply them."_s
+                        .arg((*it)->metadata().id);
+    }
+
+    if (!changed.isEmpty())
+        metadata_cache_->save();
+
+    watchPlugins();
+
+    if (!changed.isEmpty())
+        DEBG << u"[%1 ms] Python plugin rescan (%2 changed entries)"_s
+                    .arg(duration_cast<milliseconds>(system_clock::now() - start).count())
+                    .arg(changed.size());
 }
 
 vector<PluginLoader*> Plugin::plugins() const
@@ -320,7 +808,7 @@ QWidget *Plugin::buildConfigWidget()
                                       .arg(PyPluginLoader::MAJOR_INTERFACE_VERSION)
                                       .arg(PyPluginLoader::MINOR_INTERFACE_VERSION));
 
-    ui.label_python_version->setText(QString::fromUtf8(PY_VERSION));
+    ui.label_python_version->setText(QString::fromUtf8(PYTHON_VERSION));
 
     ui.label_pybind_version->setText(u"%1.%2.%3"_s
                                          .arg(PYBIND11_VERSION_MAJOR)
@@ -347,32 +835,285 @@ QWidget *Plugin::buildConfigWidget()
     connect(ui.pushButton_userPluginDir, &QPushButton::clicked,
             this, [this]{ open(userPluginDirectoryPath()); });
 
+    ui.checkBox_subinterpreters->setEnabled(Subinterpreters::isSupported());
+    ui.checkBox_subinterpreters->setChecked(settings()->value(sk_subinterpreters, false).toBool());
+    connect(ui.checkBox_subinterpreters, &QCheckBox::toggled, this, [this](bool checked)
+    {
+        settings()->setValue(sk_subinterpreters, checked);
+        if (question(tr("Changing the interpreter mode requires a restart. Restart now?")))
+            App::restart();
+    });
+
+    ui.checkBox_snapshot_items->setChecked(ItemSnapshot::enabled);
+    connect(ui.checkBox_snapshot_items, &QCheckBox::toggled, this, [this](bool checked)
+    {
+        settings()->setValue(sk_snapshot_items, checked);
+        ItemSnapshot::enabled = checked;
+    });
+
+    ui.spinBox_pull_budget->setValue(ItemGeneratorWrapper::pull_budget_ms);
+    connect(ui.spinBox_pull_budget, &QSpinBox::valueChanged, this, [this](int value)
+    {
+        settings()->setValue(sk_pull_budget, value);
+        ItemGeneratorWrapper::pull_budget_ms = value;
+    });
+
+    ui.checkBox_interrupt_cancelled->setChecked(QueryScope::interrupt_cancelled);
+    connect(ui.checkBox_interrupt_cancelled, &QCheckBox::toggled, this, [this](bool checked)
+    {
+        settings()->setValue(sk_interrupt_cancelled, checked);
+        QueryScope::interrupt_cancelled = checked;
+    });
+
+    ui.checkBox_import_profiling->setChecked(isImportProfilingEnabled());
+    connect(ui.checkBox_import_profiling, &QCheckBox::toggled,
+            this, &Plugin::setImportProfilingEnabled);
+
+    connect(ui.pushButton_import_profiles, &QPushButton::clicked, this, [this]
+    {
+        filesystem::create_directories(importProfilesPath());
+        open(importProfilesPath());
+    });
+
+    // Scheduler state for debugging. Full state in the tooltip.
+    auto update_load_queue = [this, label = ui.label_load_queue]
+    {
+        const auto state = load_scheduler_->state();
+        const auto importing = state[u"importing"_s].toString();
+        label->setText(tr("%1 checking dependencies, %2 queued, importing: %3")
+                           .arg(state[u"dependency_phase"_s].toArray().size())
+                           .arg(state[u"import_queue"_s].toArray().size())
+                           .arg(importing.isEmpty() ? tr("none") : importing));
+        label->setToolTip(QString::fromUtf8(QJsonDocument(state).toJson()));
+    };
+    update_load_queue();
+
+    auto update_gc = [this, label = ui.label_gc]
+    {
+        const auto state = gc_policy_->state();
+        const auto collections = state[u"collections"_s].toArray();
+        const auto max_pause = state[u"max_pause_ms"_s].toArray();
+        label->setText(tr("%1 collections (%2 full, longest %3 ms), %4 objects frozen")
+                           .arg(collections[0].toInt() + collections[1].toInt()
+                                + collections[2].toInt())
+                           .arg(collections[2].toInt())
+                           .arg(max_pause[2].toDouble(), 0, 'f', 1)
+                           .arg(state[u"frozen_objects"_s].toInteger()));
+        label->setToolTip(QString::fromUtf8(QJsonDocument(state).toJson()));
+    };
+    update_gc();
+
+    auto update_item_generators = [label = ui.label_item_generators]
+    {
+        const auto stats = ItemGeneratorWrapper::stats();
+        label->setText(tr("%1 items in %2 batches, %3 GIL acquisitions")
+                           .arg(stats[u"items"_s].toInteger())
+                           .arg(stats[u"batches"_s].toInteger())
+                           .arg(stats[u"gil_acquisitions"_s].toInteger()));
+        label->setToolTip(QString::fromUtf8(QJsonDocument(stats).toJson()));
+    };
+    update_item_generators();
+
+    auto *timer = new QTimer(w);
+    connect(timer, &QTimer::timeout, w, update_load_queue);
+    connect(timer, &QTimer::timeout, w, update_gc);
+    connect(timer, &QTimer::timeout, w, update_item_generators);
+    timer->start(500);
+
+    connect(ui.pushButton_startup_trace, &QPushButton::clicked, w, [this, w]
+    {
+        if (const auto file_path = QFileDialog::getSaveFileName(
+                w, tr("Export startup trace"),
+                toQString(cacheLocation() / STARTUP_TRACE),
+                tr("Trace event files (*.json)"));
+            !file_path.isEmpty())
+            startup_trace_.save(file_path);
+    });
+
     return w;
 }
 
+// PEP 503 normalized distribution name of a requirement, e.g. "Foo_Bar[x]>=1.0" -> "foo-bar"
 bool Plugin::checkPackages(const QStringList &packages) const
 {
     scoped_lock lock(pip_mutex_);
 
-    const auto stdout = run(toQString(venvPath() / BIN / PIP), {u"freeze"_s});
+    // Rebuild the snapshot of installed distributions if site-packages changed
+    error_code ec;
+    if (auto mtime = filesystem::last_write_time(siteDirPath(), ec);
+        ec || mtime != distributions_mtime_)
+    {
+        auto tp = system_clock::now();
 
-    set<QString> pkgs;
-    static const auto re_line = QRegularExpression("[\r\n]"_L1);
-    static const auto re_sep = QRegularExpression(u"==|\\s|@"_s);
-    for (const auto &line : stdout.split(re_line, Qt::SkipEmptyParts))
-        pkgs.insert(line.section(re_sep, 0, 0, QString::SectionSkipEmpty).toLower());
+        distributions_.clear();
+        for (const auto &entry : filesystem::directory_iterator(siteDirPath(), ec))
+            if (const auto ext = entry.path().extension(); ext == ".dist-info" || ext == ".egg-info")
+            {
+                // <name>-<version>.dist-info, <name>-<version>-<pyver>.egg-info
+                const auto stem = toQString(entry.path().stem());
+                distributions_.emplace(normalizedDistributionName(stem.section(u'-', 0, 0)),
+                                       stem.section(u'-', 1, 1));
+            }
+
+        if (ec)
+            WARN << "Failed reading site-packages:" << QString::fromLocal8Bit(ec.message());
+        else
+            distributions_mtime_ = mtime;
 
-    return ranges::all_of(packages,
-                          [&pkgs](const QString &pkg) { return pkgs.contains(pkg.toLower()); });
+        DEBG << u"Found %1 installed distributions in %2 µs"_s
+                    .arg(distributions_.size())
+                    .arg(duration_cast<microseconds>(system_clock::now() - tp).count());
+    }
+
+    // Requirements beyond the native check are left to pip
+    return ranges::all_of(packages, [this](const QString &pkg) {
+        return isRequirementSatisfied(pkg, distributions_).value_or(false);
+    });
 }
 
 void Plugin::installPackages(const QStringList &packages) const
 {
+    auto span = startup_trace_.span(u"Package installation"_s, u"pip"_s,
+                                    {{u"packages"_s, QJsonArray::fromStringList(packages)}});
     scoped_lock lock(pip_mutex_);
 
-    const auto stdout = run(toQString(venvPath() / BIN / PIP),
-                            QStringList{u"install"_s, u"--disable-pip-version-check"_s} << packages);
+    const auto pip = toQString(venvPath() / BIN / PIP);
+    const auto wheelhouse = toQString(wheelhousePath());
+    const QStringList install_args{u"install"_s,
+                                   u"--disable-pip-version-check"_s,
+                                   u"--no-index"_s,
+                                   u"--find-links"_s, wheelhouse};
+
+    // Try an offline installation from the local wheelhouse first. This makes venv resets and
+    // rebuilds fast and independent of the network. pip picks only wheels compatible with the
+    // venv interpreter, i.e. pure Python wheels are reused across Python versions.
+    if (is_directory(wheelhousePath()))
+    {
+        try {
+            const auto stdout = run(pip, QStringList(install_args) << packages, false);
+            distributions_mtime_.reset();  // Invalidate snapshot
+            if (!stdout.isEmpty())
+                DEBG << stdout;
+            return;
+        } catch (const exception &) {
+            DEBG << "Wheelhouse does not satisfy" << packages << "Fetching wheels.";
+        }
+    }
+
+    // Fetch or build the wheels of the packages and their dependencies into the wheelhouse.
+    // Already cached wheels are reused.
+    auto stdout = run(pip,
+                      QStringList{u"wheel"_s,
+                                  u"--disable-pip-version-check"_s,
+                                  u"--wheel-dir"_s, wheelhouse,
+                                  u"--find-links"_s, wheelhouse} << packages);
+    if (!stdout.isEmpty())
+        DEBG << stdout;
+
+    stdout = run(pip, QStringList(install_args) << packages);
+
+    distributions_mtime_.reset();  // Invalidate snapshot
 
     if (!stdout.isEmpty())
         DEBG << stdout;
 }
+
+struct Plugin::PackageBatch
+{
+    QStringList packages;
+    steady_clock::time_point opened;
+    steady_clock::time_point last_request;
+    promise<void> installed;
+    shared_future<void> future;
+};
+
+void Plugin::installPackagesBatched(const QStringList &packages) const
+{
+    // Coalesce concurrent requests (e.g. the loads of all enabled plugins on startup) into a
+    // single pip run. The first requester collects requests until no new ones arrive for a
+    // short period of time, then installs all of them at once. All requesters wait on the
+    // shared future of the batch.
+
+    static const auto quiet_period = milliseconds(250);
+    static const auto max_collect_time = seconds(2);
+
+    shared_ptr<PackageBatch> batch;
+    bool leader = false;
+    {
+        scoped_lock lock(batch_mutex_);
+
+        if (!open_batch_)
+        {
+            open_batch_ = make_shared<PackageBatch>();
+            open_batch_->opened = steady_clock::now();
+            open_batch_->future = open_batch_->installed.get_future().share();
+            leader = true;
+        }
+
+        batch = open_batch_;
+        for (const auto &package : packages)
+            if (!batch->packages.contains(package))
+                batch->packages << package;
+        batch->last_request = steady_clock::now();
+    }
+
+    if (leader)
+    {
+        QStringList batch_packages;
+        {
+            unique_lock lock(batch_mutex_);
+            for (auto deadline = batch->last_request + quiet_period;
+                 steady_clock::now() < deadline;
+                 deadline = min(batch->last_request + quiet_period,
+                                batch->opened + max_collect_time))
+            {
+                lock.unlock();
+                this_thread::sleep_until(deadline);
+                lock.lock();
+            }
+
+            open_batch_.reset();  // Close the batch
+            batch_packages = batch->packages;
+        }
+
+        DEBG << "Installing batch of packages:" << batch_packages.join(u", "_s);
+
+        try {
+            installPackages(batch_packages);
+            batch->installed.set_value();
+        } catch (...) {
+            batch->installed.set_exception(current_exception());
+        }
+    }
+
+    try {
+        batch->future.get();
+    } catch (const exception &) {
+        // A single bad requirement fails the whole batch. Isolate the error.
+        if (batch->packages.size() == packages.size())  // batch is closed, no lock required
+            throw;
+        WARN << "Batched package installation failed. Installing separately:" << packages;
+        installPackages(packages);
+    }
+}
+
+QString Plugin::findExecutable(const QString &name) const
+{
+    scoped_lock lock(executables_mutex_);
+
+    // Invalidate on $PATH changes
+    if (const auto path_env = qgetenv("PATH"); path_env != executables_path_env_)
+    {
+        executables_.clear();
+        executables_path_env_ = path_env;
+    }
+
+    if (const auto it = executables_.find(name); it != executables_.end())
+        return it->second;
+
+    // Misses are not cached, the user may install the executable any time
+    auto path = QStandardPaths::findExecutable(name);
+    if (!path.isNull())
+        executables_.emplace(name, path);
+    return path;
+}
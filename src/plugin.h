@@ -2,12 +2,24 @@
 
 #pragma once
 #include "pybind11/gil.h"
+#include "startuptrace.h"
 
 #include <albert/extensionplugin.h>
 #include <albert/plugin/applications.h>
 #include <albert/plugindependency.h>
 #include <albert/pluginprovider.h>
+#include <QFuture>
+#include <QTimer>
+#include <atomic>
+#include <future>
+#include <map>
 #include <memory>
+#include <optional>
+#include <set>
+class GcPolicy;
+class LoadScheduler;
+class QFileSystemWatcher;
+class MetadataCache;
 class PyPluginLoader;
 
 class Plugin : public albert::ExtensionPlugin,
@@ -25,12 +37,39 @@ public:
     QWidget* buildConfigWidget() override;
     std::vector<albert::PluginLoader*> plugins() const override;
 
+    /// Blocks until the virtual environment is set up. Throws if the setup failed.
+    void waitForVirtualEnvironment() const;
+
     bool checkPackages(const QStringList &packages) const;
     void installPackages(const QStringList &packages) const;
+    void installPackagesBatched(const QStringList &packages) const;
+    QString findExecutable(const QString &name) const;
+
+    MetadataCache &metadataCache() const;
+    LoadScheduler &loadScheduler() const;
+    GcPolicy &gcPolicy() const;
+    StartupTrace &startupTrace() const;
+
+    bool isImportProfilingEnabled() const;
+    void setImportProfilingEnabled(bool enabled);
+    std::filesystem::path importProfilePath(const QString &plugin_id) const;
+
+    /// Returns the interpreter to run the plugin _plugin_id_ in. Null for the main interpreter.
+    PyInterpreterState *pluginInterpreter(const QString &plugin_id) const;
 
 private:
 
-    mutable std::mutex pip_mutex_;
+    mutable std::mutex pip_mutex_;  // Also guards the distribution snapshot
+    mutable std::map<QString, QString> distributions_;  // Normalized name to version
+    mutable std::optional<std::filesystem::file_time_type> distributions_mtime_;
+
+    struct PackageBatch;
+    mutable std::mutex batch_mutex_;
+    mutable std::shared_ptr<PackageBatch> open_batch_;
+
+    mutable std::mutex executables_mutex_;
+    mutable QByteArray executables_path_env_;
+    mutable std::map<QString, QString> executables_;
 
     void initPythonInterpreter();
     void initVirtualEnvironment() const;
@@ -40,12 +79,32 @@ private:
     std::filesystem::path siteDirPath() const;
     std::filesystem::path userPluginDirectoryPath() const;
     std::filesystem::path stubFilePath() const;
+    std::filesystem::path metadataCachePath() const;
+    std::filesystem::path loadStatisticsPath() const;
+    std::filesystem::path wheelhousePath() const;
+    std::filesystem::path pycachePrefixPath() const;
+    std::filesystem::path importProfilesPath() const;
 
     std::vector<std::unique_ptr<PyPluginLoader>> scanPlugins() const;
+    void precompilePlugins(const std::vector<std::pair<QString, QString>> &plugins) const;
+    void watchPlugins();
+    void rescanPlugins();
 
     albert::StrongDependency<applications::Plugin> apps{QStringLiteral("applications")};
     std::vector<std::unique_ptr<PyPluginLoader>> loaders_;
+    mutable StartupTrace startup_trace_;
+    std::unique_ptr<MetadataCache> metadata_cache_;
+    std::unique_ptr<LoadScheduler> load_scheduler_;
+    std::unique_ptr<GcPolicy> gc_policy_;
+    std::shared_future<void> venv_ready_;
+    QFuture<void> precompilation_;
+    std::atomic_bool stop_precompilation_{false};
+    std::atomic_bool profile_imports_{false};
+    bool subinterpreters_;
     std::unique_ptr<pybind11::gil_scoped_release> release_;
+    std::unique_ptr<QFileSystemWatcher> plugin_watcher_;
+    std::map<QString, QByteArray> source_stamps_;  // Of all plugin directory entries
+    QTimer rescan_timer_;
 
 };
 
@@ -2,18 +2,27 @@
 
 #include "trampolineclasses.hpp"
 
+#include "gcpolicy.h"
+#include "importprofiler.h"
+#include "loadscheduler.h"
+#include "metadatacache.h"
+#include "metadataparser.h"
 #include "plugin.h"
+#include "subinterpreters.h"
 #include "pypluginloader.h"
+#include <QCoreApplication>
 #include <QDir>
 #include <QEventLoop>
 #include <QFileInfo>
 #include <QFutureWatcher>
 #include <QLoggingCategory>
 #include <QRegularExpression>
+#include <QThread>
 #include <QStandardPaths>
-#include <QtConcurrentRun>
 #include <albert/messagebox.h>
 #include <albert/plugininstance.h>
+#include <albert/systemutil.h>
+#include <algorithm>
 #include <chrono>
 namespace py = pybind11;
 using namespace Qt::StringLiterals;
@@ -35,6 +44,13 @@ static const auto ATTR_MD_BIN_DEPS    = "md_bin_dependencies";
 static const auto ATTR_MD_LIB_DEPS    = "md_lib_dependencies";
 static const auto ATTR_MD_CREDITS     = "md_credits";
 static const auto ATTR_MD_PLATFORMS   = "md_platforms";
+static const auto ATTR_MD_LAZY        = "md_lazy_handler";
+static const auto LAZY_KIND_TRIGGERED = u"triggered"_s;
+static const char *QT_BINDINGS[]      = {"PyQt5", "PyQt6", "PySide2", "PySide6"};
+
+// The PluginInstance constructor reads the global current_loader. Serializes instantiations on
+// different threads. Lock before acquiring the GIL, __init__ may release it.
+static mutex instantiation_mutex;
 //static const char *ATTR_MD_MINPY     = "md_min_python";
 
 static QString extractAstString(const py::handle &ast_assign_node)
@@ -52,84 +68,191 @@ static QStringList extractAstStringList(const py::handle &ast_assign_node)
     return list;
 }
 
-static PluginMetadata extractMetadata(const QString &path)
+template<class String, class StringList>
+static void assignMetadata(PyPluginMetadata &metadata, const string &name,
+                           String string_value, StringList string_list_value)
 {
-    PluginMetadata metadata;
+    if (name == ATTR_MD_IID)
+        metadata.iid = string_value();
 
-    QString source_code;
+    else if (name == ATTR_MD_NAME)
+        metadata.name = string_value();
 
-    if(QFile file(path); file.open(QIODevice::ReadOnly))
-        source_code = QTextStream(&file).readAll();
-    else
-        throw runtime_error(format("Can't open source file: {}", file.fileName().toStdString()));
+    else if (name == ATTR_MD_VERSION)
+        metadata.version = string_value();
+
+    else if (name == ATTR_MD_DESCRIPTION)
+        metadata.description = string_value();
+
+    else if (name == ATTR_MD_LICENSE)
+        metadata.license = string_value();
+
+    else if (name == ATTR_MD_URL)
+        metadata.url = string_value();
+
+    else if (name == ATTR_MD_README_URL)
+        metadata.readme_url = string_value();
+
+    else if (name == ATTR_MD_AUTHORS)
+        metadata.authors = string_list_value();
+
+    else if (name == ATTR_MD_MAINTAINERS)
+        metadata.maintainers = string_list_value();
+
+    else if (name == ATTR_MD_LIB_DEPS)
+        metadata.runtime_dependencies = string_list_value();
+
+    else if (name == ATTR_MD_BIN_DEPS)
+        metadata.binary_dependencies = string_list_value();
+
+    else if (name == ATTR_MD_CREDITS)
+        metadata.third_party_credits = string_list_value();
+
+    else if (name == ATTR_MD_PLATFORMS)
+        metadata.platforms = string_list_value();
 
-            //Parse the source code using ast and get all FunctionDef and Assign ast nodes
+    else if (name == ATTR_MD_LAZY)
+        metadata.lazy_handler = string_list_value();
+}
+
+static PyPluginMetadata extractAstMetadata(const QByteArray &source)
+{
+    PyPluginMetadata metadata;
+
+    // Parse the source code using ast and get all FunctionDef and Assign ast nodes
     py::gil_scoped_acquire acquire;
     py::module ast = py::module::import("ast");
-    py::object ast_root = ast.attr("parse")(source_code.toStdString());
-
-    map<QString, py::object> ast_assignments;
+    py::object ast_root = ast.attr("parse")(py::bytes(source.constData(), source.size()));
 
     for (auto node : ast_root.attr("body"))
-    {
         if (py::isinstance(node, ast.attr("Assign")))
-        {
             for (py::handle target : node.attr("targets"))
-            {
                 if (py::isinstance(target, ast.attr("Name")))
-                {
-                    if (auto target_name = target.attr("id").cast<string>();
-                        target_name == ATTR_MD_IID)
-                        metadata.iid = extractAstString(node);
+                    assignMetadata(metadata, target.attr("id").cast<string>(),
+                                   [&]{ return extractAstString(node); },
+                                   [&]{ return extractAstStringList(node); });
 
-                    else if (target_name == ATTR_MD_NAME)
-                        metadata.name = extractAstString(node);
+    return metadata;
+}
 
-                    else if (target_name == ATTR_MD_VERSION)
-                        metadata.version = extractAstString(node);
+static PyPluginMetadata extractMetadata(const QByteArray &source)
+{
+    // Try the GIL-free native tokenizer first
+    if (const auto assignments = parseMetadataAssignments(source))
+    {
+        try {
+            PyPluginMetadata metadata;
+            for (const auto &[name, value] : *assignments)
+                assignMetadata(metadata, name,
+                               [&]{ return get<QString>(value); },
+                               [&]{ return get<QStringList>(value); });
+            return metadata;
+        } catch (const bad_variant_access &) {
+            // Type mismatch. Let the AST path report the error.
+        }
+    }
 
-                    else if (target_name == ATTR_MD_DESCRIPTION)
-                        metadata.description = extractAstString(node);
+    return extractAstMetadata(source);
+}
 
-                    else if (target_name == ATTR_MD_LICENSE)
-                        metadata.license = extractAstString(node);
+///
+/// Stand-in for the instance of lazy plugins.
+///
+/// Provides a proxy handler with the declared id and default trigger. The actual plugin module is
+/// executed and instantiated on the first query routed to the proxy.
+///
+class PyPluginLoader::LazyPluginInstance : public PluginInstance
+{
+public:
 
-                    else if (target_name == ATTR_MD_URL)
-                        metadata.url = extractAstString(node);
+    class Handler : public GeneratorQueryHandler
+    {
+    public:
 
-                    else if (target_name == ATTR_MD_README_URL)
-                        metadata.readme_url = extractAstString(node);
+        // Copies the metadata, which changes on reloads
+        Handler(PyPluginLoader &loader) :
+            loader_(loader),
+            id_(loader.metadata_.lazy_handler[1]),
+            name_(loader.metadata_.name),
+            description_(loader.metadata_.description),
+            default_trigger_(loader.metadata_.lazy_handler[2])
+        {}
 
-                    else if (target_name == ATTR_MD_AUTHORS)
-                        metadata.authors = extractAstStringList(node);
+        QString id() const override { return id_; }
 
-                    else if (target_name == ATTR_MD_MAINTAINERS)
-                        metadata.maintainers = extractAstStringList(node);
+        QString name() const override { return name_; }
 
-                    else if (target_name == ATTR_MD_LIB_DEPS)
-                        metadata.runtime_dependencies = extractAstStringList(node);
+        QString description() const override { return description_; }
 
-                    else if (target_name == ATTR_MD_BIN_DEPS)
-                        metadata.binary_dependencies = extractAstStringList(node);
+        QString defaultTrigger() const override { return default_trigger_; }
 
-                    else if (target_name == ATTR_MD_CREDITS)
-                        metadata.third_party_credits = extractAstStringList(node);
+        QString synopsis(const QString &query) const override
+        {
+            lock_guard lock(mutex_);
+            return handler_ ? handler_->synopsis(query) : QString();
+        }
 
-                    else if (target_name == ATTR_MD_PLATFORMS)
-                        metadata.platforms = extractAstStringList(node);
+        void setTrigger(const QString &trigger) override
+        {
+            lock_guard lock(mutex_);
+            trigger_ = trigger;
+            if (handler_)
+                handler_->setTrigger(trigger);
+        }
 
-                }
-            }
+        ItemGenerator items(QueryContext &context) override
+        {
+            LoadScheduler::recordUse(this);
+            auto handler = loader_.activate();  // may throw
+            auto items = handler->items(context);  // may throw
+            return keepAlive(::move(handler), ::move(items));
         }
-    }
 
-    return metadata;
-}
+        void attach(shared_ptr<GeneratorQueryHandler> handler)
+        {
+            lock_guard lock(mutex_);
+            handler_ = ::move(handler);
+            if (!trigger_.isNull())
+                handler_->setTrigger(trigger_);
+        }
+
+    private:
+
+        // Keeps the handler alive while its items are generated
+        static ItemGenerator keepAlive(shared_ptr<GeneratorQueryHandler>, ItemGenerator items)
+        {
+            for (auto &batch : items)
+                co_yield ::move(batch);
+        }
+
+        PyPluginLoader &loader_;
+        const QString id_;
+        const QString name_;
+        const QString description_;
+        const QString default_trigger_;
+        mutable mutex mutex_;
+        shared_ptr<GeneratorQueryHandler> handler_;
+        QString trigger_;
+
+    };
+
+    LazyPluginInstance(PyPluginLoader &loader) : handler(loader) {}
+
+    vector<Extension*> extensions() override { return {&handler}; }
+
+    Handler handler;
+
+};
 
 PyPluginLoader::PyPluginLoader(const Plugin &plugin, const QString &module_path) :
     plugin_(plugin),
     module_path_(module_path),
-    instance_(nullptr)
+    instance_(nullptr),
+    pending_instance_(nullptr),
+    interpreter_(nullptr),
+    uses_qt_bindings_(false),
+    activating_(false),
+    activation_generation_(0)
 {
     const QFileInfo file_info(module_path);
     if(!file_info.exists())
@@ -145,26 +268,44 @@ PyPluginLoader::PyPluginLoader(const Plugin &plugin, const QString &module_path)
     else
         throw NoPluginException("Python package init file does not exist");
 
+    readMetadata();
+
+    //
+    // Logging category
+    //
+
+    // QLoggingCategory does not take ownership of the cstr. Keep the std::string alive.
+    logging_category_name = "albert." + metadata_.id.toUtf8().toStdString();
+    logging_category = make_unique<QLoggingCategory>(logging_category_name.c_str());
+}
+
+void PyPluginLoader::readMetadata()
+{
     //
     // Extract metadata
     //
 
-    metadata_ = extractMetadata(source_path_);
-    metadata_.id = u"python."_s + file_info.completeBaseName();  // Namespace id
-    metadata_.load_type = PluginMetadata::LoadType::User;
+    PyPluginMetadata metadata;
+    {
+        auto span = plugin_.startupTrace().span(u"Metadata"_s, u"scan"_s,
+                                                {{u"path"_s, source_path_}});
+        metadata = plugin_.metadataCache().metadata(source_path_, extractMetadata);
+    }
+    metadata.id = u"python."_s + QFileInfo(module_path_).completeBaseName();  // Namespace id
+    metadata.load_type = PluginMetadata::LoadType::User;
 
 
     //
     // Check interface
     //
 
-    if (metadata_.iid.isEmpty())
+    if (metadata.iid.isEmpty())
         throw NoPluginException("No interface id found");
 
     QStringList errors;
     static const QRegularExpression regex_version(uR"R(^(\d+)\.(\d+)$)R"_s);
 
-    if (auto match = regex_version.match(metadata_.iid); !match.hasMatch())
+    if (auto match = regex_version.match(metadata.iid); !match.hasMatch())
         errors << u"Invalid version format: '%1'. Expected <major>.<minor>."_s
                       .arg(match.captured(0));
     else if (uint maj = match.captured(1).toUInt(); maj != MAJOR_INTERFACE_VERSION)
@@ -174,113 +315,278 @@ PyPluginLoader::PyPluginLoader(const Plugin &plugin, const QString &module_path)
         errors << u"Incompatible minor interface version. Up to %1 supported, got %2."_s
                       .arg(MINOR_INTERFACE_VERSION).arg(min);
 
-    if (!metadata_.platforms.isEmpty())
+    if (!metadata.platforms.isEmpty())
 #if defined(Q_OS_MACOS)
-        if (!metadata_.platforms.contains(u"Darwin"_s))
+        if (!metadata.platforms.contains(u"Darwin"_s))
 #elif defined(Q_OS_UNIX)
-        if (!metadata_.platforms.contains(u"Linux"_s))
+        if (!metadata.platforms.contains(u"Linux"_s))
 #elif defined(Q_OS_WIN)
-        if (!metadata_.platforms.contains(u"Windows"_s))
+        if (!metadata.platforms.contains(u"Windows"_s))
 #endif
-        errors << u"Platform not supported. Supported: "_s + metadata_.platforms.join(u", "_s);
+        errors << u"Platform not supported. Supported: "_s + metadata.platforms.join(u", "_s);
 
-    //
-    // Logging category
-    //
-
-    // QLoggingCategory does not take ownership of the cstr. Keep the std::string alive.
-    logging_category_name = "albert." + metadata_.id.toUtf8().toStdString();
-    logging_category = make_unique<QLoggingCategory>(logging_category_name.c_str());
+    if (!metadata.lazy_handler.isEmpty())
+    {
+        if (metadata.lazy_handler.size() != 3 || metadata.lazy_handler[0] != LAZY_KIND_TRIGGERED)
+            errors << u"Invalid %1. Expected ['%2', <id>, <default trigger>]."_s
+                          .arg(QString::fromLatin1(ATTR_MD_LAZY), LAZY_KIND_TRIGGERED);
+        else if (metadata.lazy_handler[1].isEmpty())
+            metadata.lazy_handler[1] = metadata.id;  // Default id of plugin instance mixins
+    }
 
     // Finally set state based on errors
     if (!errors.isEmpty())
         throw runtime_error(errors.join(u", "_s).toUtf8().constData());
+
+    metadata_ = ::move(metadata);
 }
 
-PyPluginLoader::~PyPluginLoader() = default;
+PyPluginLoader::~PyPluginLoader()
+{
+    // Objects of subinterpreters have to be released in their interpreter
+    if (interpreter_ && (py_instance_ || module_))
+    {
+        InterpreterGil acquire(interpreter_, nothrow);
+        if (acquire.isAcquired())
+        {
+            py_instance_ = py::object();
+            module_ = py::object();
+        }
+        else  // Outlived its interpreter
+        {
+            py_instance_.release();
+            module_.release();
+        }
+    }
+}
 
 QString PyPluginLoader::path() const noexcept { return module_path_; }
 
 const albert::PluginMetadata &PyPluginLoader::metadata() const noexcept{ return metadata_; }
 
+void PyPluginLoader::importModule()
+{
+    auto &trace = plugin_.startupTrace();
+    const QJsonObject trace_args{{u"plugin"_s, metadata_.id}};
+
+    interpreter_ = plugin_.pluginInterpreter(metadata_.id);
+
+    const auto tp_gil = StartupTrace::Clock::now();
+    InterpreterGil acquire(interpreter_);
+    trace.record(u"GIL wait"_s, u"gil"_s, tp_gil, StartupTrace::Clock::now(), trace_args);
+
+    auto span = trace.span(u"Import"_s, u"python"_s, trace_args);
+    auto tp = system_clock::now();
+
+    // Import as __name__ = albert.package_name
+    const auto importlib_util = py::module::import("importlib.util");
+    const auto spec_from_file_location = importlib_util.attr("spec_from_file_location");
+    const auto pyspec = spec_from_file_location(u"albert.%1"_s  // Prefix to avoid conflicts
+                                                    .arg(metadata_.id), source_path_);
+    module_ = importlib_util.attr("module_from_spec")(pyspec);
+
+    // Attach logcat functions
+    // https://bugreports.qt.io/browse/QTBUG-117153
+    // https://code.qt.io/cgit/pyside/pyside-setup.git/commit/?h=6.5&id=2823763072ce3a2da0210dbc014c6ad3195fbeff
+    py::setattr(module_, "debug",
+                py::cpp_function([this](const QString &s){
+                    qCDebug((*logging_category),).noquote() << s;
+                }));
+
+    py::setattr(module_, "info",
+                py::cpp_function([this](const QString &s){
+                    qCInfo((*logging_category),).noquote() << s;
+                }));
+
+    py::setattr(module_, "warning",
+                py::cpp_function([this](const QString &s){
+                    qCWarning((*logging_category),).noquote() << s;
+                }));
+
+    py::setattr(module_, "critical",
+                py::cpp_function([this](const QString &s){
+                    qCCritical((*logging_category),).noquote() << s;
+                }));
+
+    // Execute module
+    {
+        auto exec_span = trace.span(u"exec_module"_s, u"python"_s, trace_args);
+
+        optional<ImportProfiler> profiler;
+        if (plugin_.isImportProfilingEnabled())
+            profiler.emplace();
+
+        const auto bindings_before = loadedQtBindings();
+
+        pyspec.attr("loader").attr("exec_module")(module_);
+
+        if (profiler)
+            saveImportProfile(*profiler);
+
+        // Bindings imported by other plugins before do not show up in the diff
+        uses_qt_bindings_ = loadedQtBindings() != bindings_before || referencesQtBindings();
+    }
+
+    DEBG << u"%1: Module loaded in %2 ms (%3)"_s
+                .arg(metadata().id)
+                .arg(duration_cast<milliseconds>(system_clock::now() - tp).count())
+                .arg(source_path_);
+}
+
+void PyPluginLoader::saveImportProfile(const ImportProfiler &profiler) const
+{
+    const auto file_path = plugin_.importProfilePath(metadata_.id);
+    filesystem::create_directories(file_path.parent_path());
+    if (!profiler.save(toQString(file_path)))
+        return;
+
+    const auto &records = profiler.records();
+    if (auto heaviest = ranges::max_element(records, {}, &ImportProfiler::Record::self);
+        heaviest != records.end())
+        INFO << u"%1: Imported %2 modules, heaviest '%3' (%4 ms self). Profile: %5"_s
+                    .arg(metadata_.id)
+                    .arg(records.size())
+                    .arg(heaviest->module)
+                    .arg(duration_cast<milliseconds>(heaviest->self).count())
+                    .arg(toQString(file_path));
+}
+
+static bool isQtBinding(const py::handle &module_name)
+{
+    if (!py::isinstance<py::str>(module_name))
+        return false;
+    const auto name = module_name.cast<string>();
+    const auto top_level = name.substr(0, name.find('.'));
+    return ranges::any_of(QT_BINDINGS, [&](const char *binding) { return top_level == binding; });
+}
+
+size_t PyPluginLoader::loadedQtBindings()
+{
+    const py::dict modules = py::module::import("sys").attr("modules");
+    return ranges::count_if(QT_BINDINGS, [&](const char *name) { return modules.contains(name); });
+}
+
+bool PyPluginLoader::referencesQtBindings() const
+{
+    // The module and its submodules, imported as albert.<id>.<submodule>
+    vector<py::object> modules{module_};
+    const auto prefix = u"albert.%1."_s.arg(metadata_.id);
+    for (const auto &[name, module] : py::dict(py::module::import("sys").attr("modules")))
+        if (py::isinstance<py::str>(name) && name.cast<QString>().startsWith(prefix))
+            modules.emplace_back(py::reinterpret_borrow<py::object>(module));
+
+    // Modules of bindings, e.g. `import PyQt6`, or their members, e.g. `from PyQt6 import QtCore`
+    // or `from PySide6.QtWidgets import QWidget`
+    for (const auto &module : modules)
+        if (py::hasattr(module, "__dict__"))
+            for (const auto &[key, value] : py::dict(module.attr("__dict__")))
+                if (isQtBinding(py::getattr(value,
+                                            py::isinstance<py::module_>(value) ? "__name__"
+                                                                               : "__module__",
+                                            py::none())))
+                    return true;
+    return false;
+}
+
+PluginInstance *PyPluginLoader::instantiate()
+{
+    auto &trace = plugin_.startupTrace();
+    const QJsonObject trace_args{{u"plugin"_s, metadata_.id}};
+    auto tp = system_clock::now();
+
+    PluginInstance *instance;
+    {
+        lock_guard lock(instantiation_mutex);
+        const auto tp_gil = StartupTrace::Clock::now();
+        InterpreterGil acquire(interpreter_);
+        trace.record(u"GIL wait"_s, u"gil"_s, tp_gil, StartupTrace::Clock::now(), trace_args);
+
+        auto span = trace.span(u"Instantiation"_s, u"python"_s, trace_args);
+        current_loader = this;
+
+        if (py_instance_ = module_.attr(ATTR_PLUGIN_CLASS)();  // may throw
+            !py::isinstance<PyPI>(py_instance_))
+            throw runtime_error("Python Plugin class is not of type PluginInstance.");
+
+        instance = py_instance_.cast<PluginInstance*>(); // should never fail
+    }
+
+    if (!instance)
+        throw runtime_error("Plugin instance is null.");
+
+    DEBG << u"%1: Instantiated in %2 ms (%3)"_s
+                .arg(metadata().id)
+                .arg(duration_cast<milliseconds>(system_clock::now() - tp).count())
+                .arg(QThread::currentThread() == qApp->thread() ? u"main thread"_s : u"worker thread"_s);
+
+    return instance;
+}
+
 void PyPluginLoader::load() noexcept
 {
-    auto future = QtConcurrent::run([this]
+    // Lazy plugins are imported on first use
+    // Instantiate off the main thread unless the plugin uses Qt bindings, which may create
+    // widgets in the constructor. Widgets must be created on the main thread.
+    function<void()> import;
+    if (metadata_.lazy_handler.isEmpty())
+        import = [this]
+        {
+            importModule();
+            if (!uses_qt_bindings_)
+                pending_instance_ = instantiate();
+        };
+
+    auto future = plugin_.loadScheduler().schedule(metadata_.id, [this]
     {
+        auto span = plugin_.startupTrace().span(u"Dependency check"_s, u"plugin"_s,
+                                                {{u"plugin"_s, metadata_.id}});
+
         // Check binary dependencies
         for (const auto& exec : as_const(metadata_.binary_dependencies))
-            if (QStandardPaths::findExecutable(exec).isNull())
+            if (plugin_.findExecutable(exec).isNull())
                 throw runtime_error(Plugin::tr("No '%1' in $PATH.").arg(exec).toStdString());
 
-        // Check runtime dependencies
+        // Check runtime dependencies. Only these plugins have to wait for the venv.
+        if (!metadata_.runtime_dependencies.isEmpty())
+        {
+            auto venv_span = plugin_.startupTrace().span(u"Venv wait"_s, u"plugin"_s,
+                                                         {{u"plugin"_s, metadata_.id}});
+            plugin_.waitForVirtualEnvironment();
+        }
+
         if (!metadata_.runtime_dependencies.isEmpty()
             && !plugin_.checkPackages(metadata_.runtime_dependencies))
-            plugin_.installPackages(metadata_.runtime_dependencies);
-
-        py::gil_scoped_acquire acquire;
-
-        auto tp = system_clock::now();
-
-        // Import as __name__ = albert.package_name
-        const auto importlib_util = py::module::import("importlib.util");
-        const auto spec_from_file_location = importlib_util.attr("spec_from_file_location");
-        const auto pyspec = spec_from_file_location(u"albert.%1"_s  // Prefix to avoid conflicts
-                                                        .arg(metadata_.id), source_path_);
-        module_ = importlib_util.attr("module_from_spec")(pyspec);
-
-        // Attach logcat functions
-        // https://bugreports.qt.io/browse/QTBUG-117153
-        // https://code.qt.io/cgit/pyside/pyside-setup.git/commit/?h=6.5&id=2823763072ce3a2da0210dbc014c6ad3195fbeff
-        py::setattr(module_, "debug",
-                    py::cpp_function([this](const QString &s){
-                        qCDebug((*logging_category),).noquote() << s;
-                    }));
-
-        py::setattr(module_, "info",
-                    py::cpp_function([this](const QString &s){
-                        qCInfo((*logging_category),).noquote() << s;
-                    }));
-
-        py::setattr(module_, "warning",
-                    py::cpp_function([this](const QString &s){
-                        qCWarning((*logging_category),).noquote() << s;
-                    }));
-
-        py::setattr(module_, "critical",
-                    py::cpp_function([this](const QString &s){
-                        qCCritical((*logging_category),).noquote() << s;
-                    }));
-
-        // Execute module
-        pyspec.attr("loader").attr("exec_module")(module_);
-
-        DEBG << u"%1: Module loaded in %2 ms (%3)"_s
-                    .arg(metadata().id)
-                    .arg(duration_cast<milliseconds>(system_clock::now() - tp).count())
-                    .arg(source_path_);
-    })
+            plugin_.installPackagesBatched(metadata_.runtime_dependencies);
+    },
+    ::move(import))
     .then(this, [this] {
-        auto tp = system_clock::now();
+        auto span = plugin_.startupTrace().span(u"Main thread continuation"_s, u"plugin"_s,
+                                                {{u"plugin"_s, metadata_.id}});
+        const auto tp = steady_clock::now();
 
         // CRUCIAL
         // Do not hold the GIL while emitting finished. This leads to hard to find deadlocks!
+        if (!metadata_.lazy_handler.isEmpty())
         {
-            py::gil_scoped_acquire acquire;
+            lock_guard lock(instantiation_mutex);
             current_loader = this;
-
-            if (py_instance_ = module_.attr(ATTR_PLUGIN_CLASS)();  // may throw
-                !py::isinstance<PyPI>(py_instance_))
-                throw runtime_error("Python Plugin class is not of type PluginInstance.");
-
-            instance_ = py_instance_.cast<PluginInstance*>(); // should never fail
+            lazy_instance_ = make_unique<LazyPluginInstance>(*this);
+            instance_ = lazy_instance_.get();
+            DEBG << u"%1: Deferred activation until first use of '%2'"_s
+                        .arg(metadata().id, metadata_.lazy_handler[1]);
         }
+        else if (pending_instance_)
+            instance_ = exchange(pending_instance_, nullptr);
+        else
+            instance_ = instantiate();  // Main thread fallback
 
-        if (!instance_)
-            throw runtime_error("Plugin instance is null.");
+        plugin_.loadScheduler().registerHandlers(metadata_.id, instance_->extensions());
 
-        DEBG << u"%1: Instantiated in %2 ms"_s
+        DEBG << u"%1: Main thread blocked for %2 ms"_s
                     .arg(metadata().id)
-                    .arg(duration_cast<milliseconds>(system_clock::now() - tp).count());
+                    .arg(duration_cast<milliseconds>(steady_clock::now() - tp).count());
+
+        plugin_.gcPolicy().loadFinished();
 
         emit finished({});
     })
@@ -303,16 +609,169 @@ void PyPluginLoader::load() noexcept
     });
 }
 
+shared_ptr<GeneratorQueryHandler> PyPluginLoader::activate()
+{
+    unsigned generation;
+    {
+        unique_lock lock(activation_mutex_);
+
+        // A single thread activates, concurrent queries wait for its result
+        activation_cv_.wait(lock, [this]{ return !activating_; });
+
+        if (lazy_handler_)
+            return lazy_handler_;
+        else if (!lazy_instance_)
+            throw runtime_error("Plugin is not loaded lazily.");
+        else if (!activation_error_.empty())
+            throw runtime_error(activation_error_);  // Do not retry on every query
+
+        activating_ = true;
+        generation = activation_generation_;
+    }
+
+    // Import and instantiate without holding the lock, such that unload() does not block
+    auto tp = system_clock::now();
+    shared_ptr<GeneratorQueryHandler> lazy_handler;
+    string error;
+    try {
+        auto span = plugin_.startupTrace().span(u"Activation"_s, u"plugin"_s,
+                                                {{u"plugin"_s, metadata_.id}});
+
+        importModule();
+
+        // Note that the actual instance is created on a query thread
+        auto *instance = instantiate();
+
+        GeneratorQueryHandler *handler = nullptr;
+        for (auto *extension : instance->extensions())
+            if (extension->id() == metadata_.lazy_handler[1])
+                handler = dynamic_cast<GeneratorQueryHandler*>(extension);
+
+        if (!handler)
+            throw runtime_error(format("Plugin provides no generator query handler with id '{}'.",
+                                       metadata_.lazy_handler[1].toStdString()));
+
+        // Holds a reference to the Python instance, released in its interpreter
+        shared_ptr<py::object> keep_alive;
+        {
+            InterpreterGil acquire(interpreter_);
+            keep_alive.reset(new py::object(py_instance_),
+                             [interpreter = interpreter_](py::object *instance) {
+                                 InterpreterGil acquire(interpreter, nothrow);
+                                 if (!acquire.isAcquired())  // Outlived its interpreter
+                                     instance->release();
+                                 delete instance;
+                             });
+        }
+        lazy_handler = shared_ptr<GeneratorQueryHandler>(::move(keep_alive), handler);
+    }
+    catch (const exception &e) {
+        error = e.what();
+    }
+
+    // Publish the result unless the plugin has been unloaded meanwhile
+    bool unloaded;
+    {
+        lock_guard lock(activation_mutex_);
+        unloaded = generation != activation_generation_;
+        if (!unloaded)
+        {
+            if (lazy_handler)
+            {
+                lazy_handler_ = lazy_handler;
+                lazy_instance_->handler.attach(lazy_handler_);
+            }
+            else
+                activation_error_ = error;
+            activating_ = false;
+            activation_cv_.notify_all();
+        }
+    }
+
+    if (unloaded)
+    {
+        // Drop what the activation left behind. Activations of a new load wait for this.
+        lazy_handler.reset();
+        {
+            InterpreterGil acquire(interpreter_);
+            py_instance_ = py::object();
+            module_ = py::object();
+            purgeModules();
+        }
+        {
+            lock_guard lock(activation_mutex_);
+            activating_ = false;
+        }
+        activation_cv_.notify_all();
+        throw runtime_error("Plugin has been unloaded during activation.");
+    }
+    else if (!lazy_handler)
+    {
+        WARN << metadata().id << "Activation failed:" << error;
+        throw runtime_error(error);
+    }
+
+    plugin_.gcPolicy().loadFinished();
+
+    INFO << u"%1: Activated in %2 ms"_s
+                .arg(metadata().id)
+                .arg(duration_cast<milliseconds>(system_clock::now() - tp).count());
+
+    return lazy_handler;
+}
+
 void PyPluginLoader::unload() noexcept
 {
-    py::gil_scoped_acquire acquire;
+    plugin_.loadScheduler().unregisterHandlers(metadata_.id);
+
+    {
+        lock_guard lock(activation_mutex_);
+        ++activation_generation_;  // Discards a running activation
+        instance_ = nullptr;
+        pending_instance_ = nullptr;
+        lazy_instance_.reset();
+        lazy_handler_ = nullptr;
+        activation_error_.clear();
+    }
+
+    InterpreterGil acquire(interpreter_);
 
-    instance_= nullptr;
     py_instance_ = py::object();
     module_ = py::object();
+    purgeModules();
 
     // Run garbage collection to make sure that __del__ will be called.
-    py::module::import("gc").attr("collect")();
+    // Coalesced, such that unloading many plugins costs a single collection.
+    plugin_.gcPolicy().requestCollection(interpreter_);
+}
+
+bool PyPluginLoader::reload()
+{
+    // The extensions of loaded plugins are registered in the core. Tearing them down behind its
+    // back would leave dangling registrations. The user has to reload these plugins.
+    if (instance_)
+        return false;
+
+    try {
+        readMetadata();
+    } catch (const exception &e) {
+        WARN << u"%1: Invalid metadata, keeping the previous: %2"_s
+                    .arg(metadata_.id, QString::fromStdString(e.what()));
+    }
+    return true;
+}
+
+void PyPluginLoader::purgeModules() const
+{
+    // Submodules of packages, imported as albert.<id>.<submodule>
+    const auto name = u"albert.%1"_s.arg(metadata_.id);
+    const auto prefix = name + u'.';
+    const py::dict modules = py::module::import("sys").attr("modules");
+    for (const auto &key : py::list(modules.attr("keys")()))
+        if (py::isinstance<py::str>(key))
+            if (const auto module_name = key.cast<QString>();
+                module_name == name || module_name.startsWith(prefix))
+                modules.attr("pop")(key, py::none());
 }
 
 PluginInstance *PyPluginLoader::instance() noexcept { return instance_; }
@@ -3,13 +3,20 @@
 #pragma once
 #include "pybind11/pybind11.h"
 
+#include "metadatacache.h"
 #include <QLoggingCategory>
 #include <albert/pluginloader.h>
 #include <albert/pluginmetadata.h>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+class ImportProfiler;
 class Plugin;
 class QFileInfo;
-namespace albert { class PluginProvider; }
+namespace albert {
+class GeneratorQueryHandler;
+class PluginProvider;
+}
 
 
 class NoPluginException: public std::exception
@@ -27,7 +34,7 @@ class PyPluginLoader : public albert::PluginLoader
 public:
 
     static const int MAJOR_INTERFACE_VERSION = 5;
-    static const int MINOR_INTERFACE_VERSION = 0;
+    static const int MINOR_INTERFACE_VERSION = 1;
 
     PyPluginLoader(const Plugin &plugin, const QString &module_path);
     ~PyPluginLoader();
@@ -38,19 +45,51 @@ public:
     void unload() noexcept override;
     albert::PluginInstance *instance() noexcept override;
 
+    /// Imports and instantiates the plugin of a lazy loader if not done yet.
+    /// Returns the declared handler, which keeps the Python instance alive, such that the
+    /// handler outlives a concurrent unload. Thread-safe, concurrent calls wait for a single
+    /// activation. The import runs unlocked, unload() does not wait for it. Throws on errors.
+    std::shared_ptr<albert::GeneratorQueryHandler> activate();
+
+    /// Re-reads the metadata of the current sources, such that the next load uses them. Returns
+    /// false if the plugin is loaded, i.e. its extensions are registered and the plugin has to
+    /// be reloaded by the user.
+    bool reload();
+
 private:
 
+    class LazyPluginInstance;
+
+    void readMetadata();
+    void importModule();
+    void saveImportProfile(const ImportProfiler &profiler) const;
+    void purgeModules() const;
+    albert::PluginInstance *instantiate();
+    static std::size_t loadedQtBindings();  // Requires the GIL
+    bool referencesQtBindings() const;  // Requires the GIL
+
     const Plugin &plugin_;
 
     const QString module_path_;
     QString source_path_;
 
-    albert::PluginMetadata metadata_;
+    PyPluginMetadata metadata_;
     std::string logging_category_name;
     std::unique_ptr<QLoggingCategory> logging_category;
 
     pybind11::module module_;
     pybind11::object py_instance_;
     albert::PluginInstance *instance_;
+    albert::PluginInstance *pending_instance_;  // Instantiated off the main thread
+    PyInterpreterState *interpreter_;  // Null for the main interpreter
+    bool uses_qt_bindings_;  // Instantiate on the main thread
+
+    std::unique_ptr<LazyPluginInstance> lazy_instance_;
+    std::mutex activation_mutex_;
+    std::condition_variable activation_cv_;
+    std::shared_ptr<albert::GeneratorQueryHandler> lazy_handler_;
+    std::string activation_error_;
+    bool activating_;
+    unsigned activation_generation_;  // Incremented by unload()
 
 };
@@ -0,0 +1,319 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#include "queryscope.h"
+#include "subinterpreters.h"
+#include <albert/logging.h>
+#include <albert/query.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+namespace py = pybind11;
+using namespace Qt::StringLiterals;
+using namespace albert;
+using namespace std::chrono;
+using namespace std;
+
+struct QueryScope::Entry
+{
+    QueryContext *const context;
+    PyInterpreterState *const interpreter;
+    // Lazy. Guarded by mtx, free-threaded builds have no GIL to rely on. Do not run Python
+    // code while holding mtx, it may switch threads holding the GIL.
+    mutex mtx;
+    py::object event;
+    py::object trigger;
+    py::object query;
+    py::object usage_scoring;
+    atomic<unsigned long> thread = 0;  // Running Python code of the query, if any
+    atomic_bool cancelled = false;
+    atomic_bool interrupted = false;
+    steady_clock::time_point cancelled_at;  // Monitor thread only
+    Entry *previous = nullptr;  // Entered before on the thread it is entered on
+};
+
+namespace {
+
+using Entry = QueryScope::Entry;
+
+const auto POLL_INTERVAL = 10ms;
+const auto INTERRUPT_GRACE = 100ms;  // Time to react to the event before being interrupted
+
+class Monitor
+{
+public:
+
+    Monitor() : thread_([this] { run(); }) {}
+
+    ~Monitor()
+    {
+        {
+            lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void add(const shared_ptr<Entry> &entry)
+    {
+        {
+            lock_guard lock(mutex_);
+            entries_.emplace_back(entry);
+        }
+        cv_.notify_all();
+    }
+
+    void remove(const shared_ptr<Entry> &entry)
+    {
+        lock_guard lock(mutex_);
+        erase(entries_, entry);
+    }
+
+    shared_ptr<Entry> find(const QueryContext &context, PyInterpreterState *interpreter)
+    {
+        lock_guard lock(mutex_);
+        for (const auto &entry : entries_)
+            if (entry->context == &context && entry->interpreter == interpreter)
+                return entry;
+        return {};
+    }
+
+private:
+
+    void run()
+    {
+        while (true)
+        {
+            vector<shared_ptr<Entry>> cancelled;
+            vector<shared_ptr<Entry>> overdue;
+            {
+                unique_lock lock(mutex_);
+                cv_.wait_for(lock, POLL_INTERVAL, [this] { return stop_; });
+                cv_.wait(lock, [this] { return stop_ || !entries_.empty(); });
+                if (stop_)
+                    return;
+
+                // The contexts are valid as long as registered
+                const auto now = steady_clock::now();
+                for (const auto &entry : entries_)
+                    if (!entry->cancelled && !entry->context->isValid())
+                    {
+                        entry->cancelled = true;
+                        entry->cancelled_at = now;
+                        cancelled.emplace_back(entry);
+                    }
+                    else if (entry->cancelled && !entry->interrupted && entry->thread
+                             && QueryScope::interrupt_cancelled
+                             && now - entry->cancelled_at > INTERRUPT_GRACE)
+                        overdue.emplace_back(entry);
+            }
+
+            for (const auto &entry : cancelled)
+                setEvent(*entry);
+
+            for (const auto &entry : overdue)
+                interrupt(*entry);
+        }
+    }
+
+    static void setEvent(Entry &entry)
+    {
+        try {
+            InterpreterGil acquire(entry.interpreter);
+            py::object event;
+            {
+                lock_guard lock(entry.mtx);
+                event = entry.event;
+            }
+            if (event)
+                event.attr("set")();
+        } catch (const exception &e) {
+            DEBG << "Failed setting cancellation event:" << e.what();
+        }
+    }
+
+    static void interrupt(Entry &entry)
+    {
+        try {
+            // Holding the GIL the thread can not leave the Python code of the query
+            InterpreterGil acquire(entry.interpreter);
+            if (const auto thread = entry.thread.load(); thread)
+            {
+                PyThreadState_SetAsyncExc(thread, PyExc_GeneratorExit);
+                entry.interrupted = true;
+                WARN << u"Interrupted Python query handler ignoring the cancellation (%1 ms)."_s
+                            .arg(duration_cast<milliseconds>(steady_clock::now()
+                                                             - entry.cancelled_at).count());
+            }
+        } catch (const exception &e) {
+            DEBG << "Failed interrupting query:" << e.what();
+        }
+    }
+
+    mutex mutex_;
+    condition_variable cv_;
+    vector<shared_ptr<Entry>> entries_;
+    bool stop_ = false;
+    thread thread_;  // Last, started in the initializer list
+
+};
+
+Monitor &monitor()
+{
+    static Monitor m;
+    return m;
+}
+
+thread_local Entry *current_entry = nullptr;  // Entered by the thread
+
+// Returns the entry of _context_ in the current interpreter, if any. Tries the entry entered by
+// the calling thread first, which does not lock the monitor. _hold_ keeps others alive.
+Entry *findEntry(const QueryContext &context, shared_ptr<Entry> &hold)
+{
+    const auto interpreter = currentInterpreter();
+    if (auto *entry = current_entry;
+        entry && entry->context == &context && entry->interpreter == interpreter)
+        return entry;
+
+    hold = monitor().find(context, interpreter);  // E.g. on the asyncio loop thread
+    return hold.get();
+}
+
+// Returns the object stored in _member_, stores the result of _make_ if none. Requires the GIL.
+template<class Make>
+py::object storeOnce(Entry &entry, py::object Entry::*member, Make make)
+{
+    {
+        lock_guard lock(entry.mtx);
+        if (const auto &object = entry.*member; object)
+            return object;
+    }
+
+    auto object = make();  // Python code, outside of the lock
+
+    lock_guard lock(entry.mtx);
+    if (auto &stored = entry.*member; !stored)
+        stored = object;
+    return entry.*member;  // The first one stored wins
+}
+
+}
+
+QueryScope::QueryScope(QueryContext &context):
+    entry_(make_shared<Entry>(&context, currentInterpreter()))
+{
+    enter();
+    monitor().add(entry_);
+}
+
+QueryScope::~QueryScope()
+{
+    if (!entry_)  // Abandoned
+        return;
+
+    leave();
+    monitor().remove(entry_);
+
+    // The monitor may still hold the entry. Release the objects in this interpreter, after
+    // the lock is released.
+    py::object event, trigger, query, usage_scoring;
+    lock_guard lock(entry_->mtx);
+    event = ::move(entry_->event);
+    trigger = ::move(entry_->trigger);
+    query = ::move(entry_->query);
+    usage_scoring = ::move(entry_->usage_scoring);
+}
+
+void QueryScope::abandon() noexcept
+{
+    if (!entry_)
+        return;
+
+    monitor().remove(entry_);
+    if (current_entry == entry_.get())
+        current_entry = entry_->previous;
+
+    // The interpreter is gone, leak the references
+    {
+        lock_guard lock(entry_->mtx);
+        entry_->event.release();
+        entry_->trigger.release();
+        entry_->query.release();
+        entry_->usage_scoring.release();
+    }
+    entry_.reset();
+}
+
+void QueryScope::enter()
+{
+    entry_->thread = PyThread_get_thread_ident();
+    if (current_entry != entry_.get())
+        entry_->previous = exchange(current_entry, entry_.get());
+}
+
+void QueryScope::leave()
+{
+    entry_->thread = 0;
+    if (current_entry == entry_.get())
+        current_entry = entry_->previous;
+    if (entry_->interrupted)  // Possibly not delivered yet
+        PyThreadState_SetAsyncExc(PyThread_get_thread_ident(), nullptr);
+}
+
+py::object QueryScope::cancellationEvent(const QueryContext &context)
+{
+    auto threading = py::module::import("threading");
+
+    shared_ptr<Entry> hold;
+    if (auto *entry = findEntry(context, hold); entry)
+    {
+        auto event = storeOnce(*entry, &Entry::event, [&]{ return threading.attr("Event")(); });
+
+        // Stored before reading the flag, the monitor sets it otherwise
+        if (entry->cancelled)
+            event.attr("set")();
+        return event;
+    }
+
+    // Not running in a registered scope. Reflect the current state.
+    auto event = threading.attr("Event")();
+    if (!context.isValid())
+        event.attr("set")();
+    return event;
+}
+
+namespace {
+
+template<class Make>
+py::object memoized(const QueryContext &context, py::object Entry::*member, Make make)
+{
+    shared_ptr<Entry> hold;
+    auto *entry = findEntry(context, hold);
+    if (!entry)  // Not running in a registered scope
+        return make();
+    return storeOnce(*entry, member, make);
+}
+
+}
+
+py::object QueryScope::trigger(const QueryContext &context)
+{
+    return memoized(context, &Entry::trigger, [&]
+    {
+        auto trigger = py::cast(context.trigger());
+        PyUnicode_InternInPlace(&trigger.ptr());  // Few distinct values
+        return trigger;
+    });
+}
+
+py::object QueryScope::query(const QueryContext &context)
+{ return memoized(context, &Entry::query, [&] { return py::cast(context.query()); }); }
+
+py::object QueryScope::usageScoring(const QueryContext &context)
+{
+    return memoized(context, &Entry::usage_scoring, [&]
+    { return py::cast(&context.usageScoring(), py::return_value_policy::reference); });
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#pragma once
+#include <pybind11/pybind11.h>
+#include <atomic>
+#include <memory>
+namespace albert { class QueryContext; }
+
+
+///
+/// Per query state of Python handlers, for the duration of a call into Python.
+///
+/// Cancellation: The core invalidates the context of a superseded query, but does not notify its
+/// handlers. A monitor thread polls the contexts of the queries running Python code and sets their
+/// cancellation events (threading.Event), which Python code can poll or wait on without calling
+/// into the bindings. Optionally handlers ignoring the cancellation are interrupted by raising
+/// GeneratorExit asynchronously in the thread running them.
+///
+/// Memoization: Handlers access the context properties in per item loops. The Python objects of
+/// the properties are created once per scope. The bindings find them using the scope entered by
+/// the calling thread, without locking the monitor. Triggers are interned.
+///
+class QueryScope
+{
+public:
+
+    /// Registers _context_ in the current interpreter and enters. Requires the GIL.
+    explicit QueryScope(albert::QueryContext &context);
+
+    /// Leaves and unregisters. Requires the GIL, unless abandoned.
+    ~QueryScope();
+
+    /// Unregisters without touching Python state. For when the interpreter does not exist
+    /// anymore. Does not require the GIL.
+    void abandon() noexcept;
+
+    /// Marks the calling thread as running Python code of the query. Requires the GIL.
+    void enter();
+
+    /// Unmarks the calling thread and discards an interrupt not delivered. Requires the GIL.
+    void leave();
+
+    QueryScope(const QueryScope &) = delete;
+    QueryScope &operator=(const QueryScope &) = delete;
+
+    /// Interrupt Python code of cancelled queries. Off by default.
+    inline static std::atomic_bool interrupt_cancelled = false;
+
+    /// Returns the cancellation event of _context_ in the current interpreter. Set when the
+    /// context became invalid. Requires the GIL.
+    static pybind11::object cancellationEvent(const albert::QueryContext &context);
+
+    /// Returns the trigger of _context_ as str, memoized and interned. Requires the GIL.
+    static pybind11::object trigger(const albert::QueryContext &context);
+
+    /// Returns the query string of _context_ as str, memoized. Requires the GIL.
+    static pybind11::object query(const albert::QueryContext &context);
+
+    /// Returns the usage scoring of _context_, memoized. Requires the GIL.
+    static pybind11::object usageScoring(const albert::QueryContext &context);
+
+    struct Entry;
+
+private:
+
+    std::shared_ptr<Entry> entry_;
+
+};
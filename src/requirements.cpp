@@ -0,0 +1,120 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#include "requirements.h"
+#include <QRegularExpression>
+#include <QStringList>
+#include <algorithm>
+#include <vector>
+using namespace Qt::StringLiterals;
+using namespace std;
+
+namespace {
+
+using Release = vector<uint>;
+
+// Plain release versions only, e.g. "1.2.3". Pre-, post-, dev-releases and local versions have
+// orderings of their own.
+optional<Release> parseRelease(const QString &version)
+{
+    static const QRegularExpression re(uR"(^v?(\d+(?:\.\d+)*)$)"_s);
+    const auto match = re.match(version.trimmed());
+    if (!match.hasMatch())
+        return nullopt;
+
+    Release release;
+    for (const auto &segment : match.capturedView(1).split(u'.'))
+        release.push_back(segment.toUInt());
+    return release;
+}
+
+// Compares with trailing zeros padded, i.e. 1.0 == 1.0.0
+int compare(Release a, Release b)
+{
+    const auto size = max(a.size(), b.size());
+    a.resize(size, 0);
+    b.resize(size, 0);
+    return a < b ? -1 : a > b ? 1 : 0;
+}
+
+// Whether the leading segments of the installed version equal the prefix, i.e. 1.2.* matches 1.2
+bool matchesPrefix(Release installed, const Release &prefix)
+{
+    installed.resize(max(installed.size(), prefix.size()), 0);
+    return equal(prefix.begin(), prefix.end(), installed.begin());
+}
+
+optional<bool> satisfies(const Release &installed, const QString &specifier)
+{
+    static const QRegularExpression re(uR"(^\s*(~=|===|==|!=|<=|>=|<|>)\s*(\S+?)(\.\*)?\s*$)"_s);
+    const auto match = re.match(specifier);
+    if (!match.hasMatch())
+        return nullopt;
+
+    const auto op = match.captured(1);
+    const bool wildcard = match.hasCaptured(3);
+    const auto version = parseRelease(match.captured(2));
+    if (!version || op == u"==="_s || (wildcard && op != u"=="_s && op != u"!="_s))
+        return nullopt;
+
+    if (wildcard)
+        return matchesPrefix(installed, *version) == (op == u"=="_s);
+
+    const auto c = compare(installed, *version);
+    if (op == u"=="_s)
+        return c == 0;
+    else if (op == u"!="_s)
+        return c != 0;
+    else if (op == u"<="_s)
+        return c <= 0;
+    else if (op == u">="_s)
+        return c >= 0;
+    else if (op == u"<"_s)
+        return c < 0;
+    else if (op == u">"_s)
+        return c > 0;
+    else if (version->size() < 2)  // ~= requires at least two segments
+        return nullopt;
+    else  // ~=1.4.5 is >=1.4.5, ==1.4.*
+        return c >= 0 && matchesPrefix(installed, Release(version->begin(), version->end() - 1));
+}
+
+}
+
+QString normalizedDistributionName(const QString &requirement)
+{
+    static const auto re_name = QRegularExpression(u"^\\s*([A-Za-z0-9][A-Za-z0-9._-]*)"_s);
+    static const auto re_sep = QRegularExpression(u"[-_.]+"_s);
+    return re_name.match(requirement).captured(1).replace(re_sep, u"-"_s).toLower();
+}
+
+optional<bool> isRequirementSatisfied(const QString &requirement,
+                                      const map<QString, QString> &distributions)
+{
+    static const QRegularExpression re(uR"(^\s*[A-Za-z0-9][A-Za-z0-9._-]*\s*(.*?)\s*$)"_s);
+    const auto match = re.match(requirement);
+    if (!match.hasMatch())
+        return nullopt;
+
+    // Extras, URLs and environment markers are left to pip
+    auto specifiers = match.captured(1);
+    if (specifiers.contains(u'[') || specifiers.contains(u'@') || specifiers.contains(u';'))
+        return nullopt;
+
+    const auto it = distributions.find(normalizedDistributionName(requirement));
+    if (it == distributions.end())
+        return false;
+
+    if (specifiers.startsWith(u'(') && specifiers.endsWith(u')'))
+        specifiers = specifiers.mid(1, specifiers.size() - 2);
+    if (specifiers.trimmed().isEmpty())
+        return true;
+
+    const auto installed = parseRelease(it->second);
+    if (!installed)
+        return nullopt;
+
+    for (const auto &specifier : specifiers.split(u','))
+        if (const auto satisfied = satisfies(*installed, specifier); !satisfied || !*satisfied)
+            return satisfied;
+    return true;
+}
@@ -0,0 +1,24 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#pragma once
+#include <QString>
+#include <map>
+#include <optional>
+
+///
+/// Returns the normalized name of the distribution of a requirement, e.g. "foo-bar" for
+/// "Foo_Bar>=1.0" (PEP 503).
+///
+QString normalizedDistributionName(const QString &requirement);
+
+///
+/// Checks a requirement like "foo>=1.2,!=1.3" against installed distributions, i.e. normalized
+/// names mapped to their versions.
+///
+/// Handles release versions and the comparison operators of PEP 440, including wildcards.
+/// Returns std::nullopt if the requirement is beyond this check, e.g. if it has extras, a URL
+/// or an environment marker or if any of the versions involved is not a plain release version.
+/// In this case the caller should let pip decide.
+///
+std::optional<bool> isRequirementSatisfied(const QString &requirement,
+                                           const std::map<QString, QString> &distributions);
@@ -0,0 +1,128 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#include "startuptrace.h"
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QThread>
+#include <albert/logging.h>
+using namespace Qt::StringLiterals;
+using namespace std::chrono;
+using namespace std;
+
+StartupTrace::Span::Span(StartupTrace &trace, const QString &name, const QString &category,
+                         const QJsonObject &args):
+    trace_(trace),
+    name_(name),
+    category_(category),
+    args_(args),
+    begin_(Clock::now())
+{}
+
+StartupTrace::Span::~Span() { trace_.record(name_, category_, begin_, Clock::now(), args_); }
+
+void StartupTrace::Span::setArg(const QString &key, const QJsonValue &value)
+{ args_.insert(key, value); }
+
+StartupTrace::StartupTrace() : origin_(Clock::now()) {}
+
+StartupTrace::Span StartupTrace::span(const QString &name, const QString &category,
+                                      const QJsonObject &args)
+{ return Span(*this, name, category, args); }
+
+void StartupTrace::record(const QString &name, const QString &category,
+                          Clock::time_point begin, Clock::time_point end,
+                          const QJsonObject &args)
+{
+    lock_guard lock(mutex_);
+
+    if (events_.size() >= MAX_EVENTS)
+    {
+        if (dropped_++ == 0)
+            WARN << "Startup trace full. Dropping further spans.";
+        return;
+    }
+
+    auto it = threads_.find(this_thread::get_id());
+    if (it == threads_.end())
+    {
+        const auto tid = static_cast<int>(threads_.size()) + 1;
+        auto *thread = QThread::currentThread();
+        QString thread_name;
+        if (auto *app = QCoreApplication::instance(); app && thread == app->thread())
+            thread_name = u"Main thread"_s;
+        else if (!thread->objectName().isEmpty())
+            thread_name = u"%1 %2"_s.arg(thread->objectName()).arg(tid);
+        else
+            thread_name = u"Thread %1"_s.arg(tid);
+        it = threads_.emplace(this_thread::get_id(), Thread{tid, thread_name}).first;
+    }
+
+    events_.push_back(Event{
+        .name = name,
+        .category = category,
+        .ts = duration_cast<microseconds>(begin - origin_).count(),
+        .dur = duration_cast<microseconds>(end - begin).count(),
+        .tid = it->second.tid,
+        .args = args
+    });
+}
+
+QByteArray StartupTrace::toJson() const
+{
+    const auto pid = QCoreApplication::applicationPid();
+
+    QJsonArray trace_events;
+    lock_guard lock(mutex_);
+
+    trace_events.append(QJsonObject{
+        {u"name"_s, u"process_name"_s},
+        {u"ph"_s, u"M"_s},
+        {u"pid"_s, pid},
+        {u"args"_s, QJsonObject{{u"name"_s, u"albert python"_s}}}
+    });
+
+    for (const auto &[id, thread] : threads_)
+        trace_events.append(QJsonObject{
+            {u"name"_s, u"thread_name"_s},
+            {u"ph"_s, u"M"_s},
+            {u"pid"_s, pid},
+            {u"tid"_s, thread.tid},
+            {u"args"_s, QJsonObject{{u"name"_s, thread.name}}}
+        });
+
+    for (const auto &e : events_)
+        trace_events.append(QJsonObject{
+            {u"name"_s, e.name},
+            {u"cat"_s, e.category},
+            {u"ph"_s, u"X"_s},
+            {u"ts"_s, e.ts},
+            {u"dur"_s, e.dur},
+            {u"pid"_s, pid},
+            {u"tid"_s, e.tid},
+            {u"args"_s, e.args}
+        });
+
+    return QJsonDocument(QJsonObject{
+        {u"traceEvents"_s, trace_events},
+        {u"displayTimeUnit"_s, u"ms"_s},
+        {u"otherData"_s, QJsonObject{{u"dropped_events"_s, static_cast<qint64>(dropped_)}}}
+    }).toJson(QJsonDocument::Compact);
+}
+
+bool StartupTrace::save(const QString &file_path) const
+{
+    QSaveFile file(file_path);
+    if (file.open(QIODevice::WriteOnly))
+    {
+        file.write(toJson());
+        if (file.commit())
+        {
+            INFO << "Wrote startup trace to" << file_path;
+            return true;
+        }
+    }
+    WARN << "Failed writing startup trace" << file_path << file.errorString();
+    return false;
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#pragma once
+#include <QJsonObject>
+#include <QString>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+///
+/// Timeline of the plugin startup.
+///
+/// Records spans with the thread they ran on and exports them in the Chrome trace event format,
+/// which can be viewed using chrome://tracing or https://ui.perfetto.dev. Thread-safe.
+///
+/// Spans are recorded for the lifetime of the plugin, e.g. of later plugin loads and package
+/// installations. The trace keeps the first MAX_EVENTS spans and drops later ones.
+///
+class StartupTrace
+{
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    /// Maximum number of recorded spans.
+    static constexpr std::size_t MAX_EVENTS = 10'000;
+
+    ///
+    /// Records a span from construction to destruction.
+    ///
+    class Span
+    {
+    public:
+
+        Span(StartupTrace &trace, const QString &name, const QString &category,
+             const QJsonObject &args = {});
+        ~Span();
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+        /// Adds an argument shown in the details of the span.
+        void setArg(const QString &key, const QJsonValue &value);
+
+    private:
+
+        StartupTrace &trace_;
+        const QString name_;
+        const QString category_;
+        QJsonObject args_;
+        const Clock::time_point begin_;
+
+    };
+
+    StartupTrace();
+
+    /// Returns a span recording until it goes out of scope.
+    [[nodiscard]] Span span(const QString &name, const QString &category,
+                            const QJsonObject &args = {});
+
+    /// Records a span of the current thread. Drops the span if the trace is full.
+    void record(const QString &name, const QString &category,
+                Clock::time_point begin, Clock::time_point end,
+                const QJsonObject &args = {});
+
+    /// Returns the trace as Chrome trace event JSON.
+    QByteArray toJson() const;
+
+    /// Writes the trace to _file_path_. Returns false on failure.
+    bool save(const QString &file_path) const;
+
+private:
+
+    struct Event
+    {
+        QString name;
+        QString category;
+        qint64 ts;   // µs since origin
+        qint64 dur;  // µs
+        int tid;
+        QJsonObject args;
+    };
+
+    struct Thread
+    {
+        int tid;
+        QString name;
+    };
+
+    const Clock::time_point origin_;
+    mutable std::mutex mutex_;
+    std::vector<Event> events_;
+    std::size_t dropped_ = 0;
+    std::map<std::thread::id, Thread> threads_;
+
+};
@@ -0,0 +1,152 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#include "subinterpreters.h"
+#include <albert/logging.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+using namespace std;
+namespace py = pybind11;
+
+PyInterpreterState *currentInterpreter() { return PyInterpreterState_Get(); }
+
+#if ALBERT_PYTHON_SUBINTERPRETERS
+
+namespace {
+
+struct Registry
+{
+    mutex mtx;
+    struct Entry
+    {
+        unique_ptr<py::subinterpreter> subinterpreter;
+        PyInterpreterState *state;
+    };
+
+    map<QString, Entry> by_plugin;
+    map<PyInterpreterState*, py::subinterpreter*> by_state;  // Never dereference the key
+    map<QString, shared_ptr<mutex>> creation_mutexes;  // Serialize creation per plugin
+};
+
+Registry &registry()
+{
+    static Registry r;
+    return r;
+}
+
+}
+
+InterpreterGil::InterpreterGil(PyInterpreterState *interpreter)
+{
+    if (!acquire(interpreter))
+        throw runtime_error("The interpreter of the object does not exist anymore.");
+}
+
+InterpreterGil::InterpreterGil(PyInterpreterState *interpreter, nothrow_t)
+{ acquire(interpreter); }
+
+bool InterpreterGil::acquire(PyInterpreterState *interpreter)
+{
+    if (interpreter && interpreter != PyInterpreterState_Main())
+    {
+        // The state may be freed already, look it up by address
+        py::subinterpreter *subinterpreter = nullptr;
+        {
+            auto &r = registry();
+            lock_guard lock(r.mtx);
+            if (auto it = r.by_state.find(interpreter); it != r.by_state.end())
+                subinterpreter = it->second;
+        }
+
+        if (!subinterpreter)
+            return false;
+
+        activation_.emplace(*subinterpreter);
+    }
+    else
+        gil_.emplace();
+    return true;
+}
+
+bool InterpreterGil::isAcquired() const { return gil_.has_value() || activation_.has_value(); }
+
+bool Subinterpreters::isSupported() { return true; }
+
+PyInterpreterState *Subinterpreters::get(const QString &plugin_id, const function<void()> &init)
+{
+    auto &r = registry();
+
+    shared_ptr<mutex> creation_mutex;
+    {
+        lock_guard lock(r.mtx);
+        if (auto it = r.by_plugin.find(plugin_id); it != r.by_plugin.end())
+            return it->second.state;
+
+        auto &m = r.creation_mutexes[plugin_id];
+        if (!m)
+            m = make_shared<mutex>();
+        creation_mutex = m;
+    }
+
+    // Concurrent callers for the same plugin wait for the first one to create the interpreter
+    lock_guard creation_lock(*creation_mutex);
+    {
+        lock_guard lock(r.mtx);
+        if (auto it = r.by_plugin.find(plugin_id); it != r.by_plugin.end())
+            return it->second.state;
+    }
+
+    // Like the isolated default, but plugins commonly use subprocesses and threads
+    PyInterpreterConfig config{};
+    config.use_main_obmalloc = 0;
+    config.allow_fork = 0;
+    config.allow_exec = 1;
+    config.allow_threads = 1;
+    config.allow_daemon_threads = 1;
+    config.check_multi_interp_extensions = 1;  // Required for an own GIL
+    config.gil = PyInterpreterConfig_OWN_GIL;
+
+    auto subinterpreter = make_unique<py::subinterpreter>(py::subinterpreter::create(config));
+
+    PyInterpreterState *state;
+    {
+        py::subinterpreter_scoped_activate activation(*subinterpreter);
+        state = PyInterpreterState_Get();
+        init();  // may throw
+    }
+
+    DEBG << "Created subinterpreter" << subinterpreter->id() << "for" << plugin_id;
+
+    lock_guard lock(r.mtx);
+    r.by_state.emplace(state, subinterpreter.get());
+    r.by_plugin.emplace(plugin_id, Registry::Entry{::move(subinterpreter), state});
+    r.creation_mutexes.erase(plugin_id);
+    return state;
+}
+
+void Subinterpreters::clear()
+{
+    auto &r = registry();
+    lock_guard lock(r.mtx);
+    r.by_state.clear();
+    r.by_plugin.clear();
+    r.creation_mutexes.clear();
+}
+
+#else
+
+InterpreterGil::InterpreterGil(PyInterpreterState *) { gil_.emplace(); }
+
+InterpreterGil::InterpreterGil(PyInterpreterState *, nothrow_t) { gil_.emplace(); }
+
+bool InterpreterGil::isAcquired() const { return true; }
+
+bool Subinterpreters::isSupported() { return false; }
+
+PyInterpreterState *Subinterpreters::get(const QString &, const function<void()> &)
+{ throw runtime_error("Subinterpreters are not supported by this build."); }
+
+void Subinterpreters::clear() {}
+
+#endif
@@ -0,0 +1,87 @@
+// Copyright (c) 2025 Manuel Schneider
+
+#pragma once
+#include <pybind11/gil.h>
+#include <QString>
+#include <functional>
+#include <new>
+#include <optional>
+#if defined(PYBIND11_HAS_SUBINTERPRETER_SUPPORT) && PY_VERSION_HEX >= 0x030C0000
+#include <pybind11/subinterpreter.h>
+#define ALBERT_PYTHON_SUBINTERPRETERS 1
+#else
+#define ALBERT_PYTHON_SUBINTERPRETERS 0
+#endif
+
+
+/// Returns the interpreter of the calling thread. Requires the GIL.
+PyInterpreterState *currentInterpreter();
+
+
+///
+/// Scoped GIL of a specific interpreter.
+///
+/// Activates the subinterpreter _interpreter_ on the calling thread and acquires its GIL.
+/// Acquires the GIL of the main interpreter if _interpreter_ is the main interpreter or null.
+///
+class InterpreterGil
+{
+public:
+
+    /// Throws if the subinterpreter does not exist anymore.
+    explicit InterpreterGil(PyInterpreterState *interpreter);
+
+    /// Does not throw if the subinterpreter does not exist anymore, see isAcquired(). For
+    /// destructors, which have to leak their Python references then.
+    InterpreterGil(PyInterpreterState *interpreter, std::nothrow_t);
+
+    InterpreterGil(const InterpreterGil &) = delete;
+    InterpreterGil &operator=(const InterpreterGil &) = delete;
+
+    /// Returns false if the subinterpreter did not exist anymore.
+    bool isAcquired() const;
+
+private:
+
+#if ALBERT_PYTHON_SUBINTERPRETERS
+    bool acquire(PyInterpreterState *interpreter);
+    std::optional<pybind11::subinterpreter_scoped_activate> activation_;
+#endif
+    std::optional<pybind11::gil_scoped_acquire> gil_;
+
+};
+
+
+///
+/// Remembers the interpreter an object has been created in.
+///
+/// Mixin for trampolines. Python state of the object must only be touched using an
+/// InterpreterGil of this interpreter.
+///
+struct InterpreterAffinity
+{
+    PyInterpreterState *const interpreter = currentInterpreter();
+};
+
+
+///
+/// Subinterpreters having their own GIL (PEP 684), one per plugin.
+///
+/// Subinterpreters are created on demand and live until destruction of the registry, since
+/// objects created in them (e.g. actions) may outlive the plugin instance.
+///
+namespace Subinterpreters
+{
+
+/// Returns true if this build supports subinterpreters having their own GIL.
+bool isSupported();
+
+/// Returns the subinterpreter of the plugin _plugin_id_. Creates it if necessary and calls
+/// _init_ with the subinterpreter active. Thread-safe, concurrent calls for the same plugin create
+/// a single subinterpreter. Must not be called holding a GIL. Throws on failure.
+PyInterpreterState *get(const QString &plugin_id, const std::function<void()> &init);
+
+/// Destroys all subinterpreters. No Python code must run in them anymore.
+void clear();
+
+}
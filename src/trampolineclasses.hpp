@@ -3,12 +3,18 @@
 #pragma once
 
 #include "cast_specialization.hpp"  // Has to be imported first
+#include "asyncioloop.h"
+#include "gcpolicy.h"
+#include "loadscheduler.h"
+#include "queryscope.h"
+#include "subinterpreters.h"
 
 #include <QCheckBox>
 #include <QComboBox>
 #include <QDir>
 #include <QDoubleSpinBox>
 #include <QFormLayout>
+#include <QJsonObject>
 #include <QLabel>
 #include <QLineEdit>
 #include <QSettings>
@@ -23,6 +29,8 @@
 #include <albert/plugininstance.h>
 #include <albert/pluginloader.h>
 #include <albert/pluginmetadata.h>
+#include <chrono>
+#include <mutex>
 using namespace Qt::StringLiterals;
 using namespace albert;
 using namespace std;
@@ -31,19 +39,19 @@ using namespace std;
 // See https://github.com/pybind/pybind11/issues/5405
 #define WORKAROUND_PYBIND_5405(name) \
 QString name() const override { \
-    py::gil_scoped_acquire gil; \
+    InterpreterGil gil(this->interpreter); \
     if (auto py_instance = py::cast(this); py::isinstance<PluginInstance>(py_instance)) \
         return py::cast<PluginInstance*>(py_instance)->loader().metadata().name; \
     PYBIND11_OVERRIDE_PURE(QString, Base, name, ); \
 }
 
-class PyPI : public PluginInstance
+class PyPI : public PluginInstance, public InterpreterAffinity
 {
 public:
 
     vector<Extension *> extensions() override
     {
-        py::gil_scoped_acquire gil;
+        InterpreterGil gil(interpreter);
         py::function override = py::get_override(this, "extensions");
         if (override)
             return override().cast<std::vector<Extension *>>();  // may throw, is okay
@@ -55,7 +63,8 @@ public:
 
     void writeConfig(QString key, const py::object &value) const
     {
-        py::gil_scoped_acquire a;
+        InterpreterGil a(interpreter);
+        lock_guard lock(settings_mutex_);  // No GIL serializing in free-threaded builds
         auto s = this->settings();
 
         if (py::isinstance<py::str>(value))
@@ -76,8 +85,12 @@ public:
 
     py::object readConfig(QString key, const py::object &type) const
     {
-        py::gil_scoped_acquire a;
-        QVariant var = this->settings()->value(key);
+        InterpreterGil a(interpreter);
+        QVariant var;
+        {
+            lock_guard lock(settings_mutex_);
+            var = this->settings()->value(key);
+        }
 
         if (var.isNull())
             return py::none();
@@ -116,7 +129,7 @@ public:
 
         try
         {
-            py::gil_scoped_acquire a;
+            InterpreterGil a(interpreter);
             if (auto override = pybind11::get_override(static_cast<const PluginInstance*>(this), "configWidget"))
             {
                 for (auto item : py::list(override()))
@@ -132,7 +145,7 @@ public:
                         fw->setText(getattr<QString>(property_name));
 
                         QObject::connect(fw, &QLineEdit::editingFinished, fw, [this, fw, property_name](){
-                            py::gil_scoped_acquire aq;
+                            InterpreterGil aq(interpreter);
                             try { setattr(property_name, fw->text()); }
                             catch (const std::exception &e) { CRIT << e.what(); }
                         });
@@ -149,7 +162,7 @@ public:
                         fw->setChecked(getattr<bool>(property_name));
 
                         QObject::connect(fw, &QCheckBox::toggled, fw, [this, property_name](bool checked){
-                            py::gil_scoped_acquire aq;
+                            InterpreterGil aq(interpreter);
                             try { setattr(property_name, checked); }
                             catch (const std::exception &e) { CRIT << e.what(); }
                         });
@@ -169,7 +182,7 @@ public:
                         fw->setCurrentText(getattr<QString>(property_name));
 
                         QObject::connect(fw, &QComboBox::currentIndexChanged, fw, [this, cb=fw, property_name](){
-                            py::gil_scoped_acquire aq;
+                            InterpreterGil aq(interpreter);
                             try { setattr(property_name, cb->currentText()); }
                             catch (const std::exception &e) { CRIT << e.what(); }
                         });
@@ -186,7 +199,7 @@ public:
                         fw->setValue(getattr<int>(property_name));
 
                         QObject::connect(fw, &QSpinBox::valueChanged, fw, [this, property_name](int value){
-                            py::gil_scoped_acquire aq;
+                            InterpreterGil aq(interpreter);
                             try { setattr(property_name, value); }
                             catch (const std::exception &e) { CRIT << e.what(); }
                         });
@@ -203,7 +216,7 @@ public:
                         fw->setValue(getattr<double>(property_name));
 
                         QObject::connect(fw, &QDoubleSpinBox::valueChanged, fw, [this, property_name](double value){
-                            py::gil_scoped_acquire aq;
+                            InterpreterGil aq(interpreter);
                             try { setattr(property_name, value); }
                             catch (const std::exception &e) { CRIT << e.what(); }
                         });
@@ -237,6 +250,8 @@ public:
 
 private:
 
+    mutable std::mutex settings_mutex_;
+
     /// Get a property of this Python instance
     /// DOES NOT LOCK THE GIL!
     template <class T>
@@ -279,9 +294,20 @@ private:
 };
 
 
-class PyItemTrampoline : public Item, public py::trampoline_self_life_support
+class PyItemTrampoline : public Item,
+                         public py::trampoline_self_life_support,
+                         public InterpreterAffinity
 {
 public:
+    // The Python object may be released by the core on any thread. pybind11 does this using the
+    // GIL of the main interpreter, which is invalid for objects of subinterpreters.
+    PyItemTrampoline()
+    {
+        if (interpreter != PyInterpreterState_Main())
+            throw py::type_error("Item subclasses are not supported in subinterpreters. "
+                                 "Use StandardItem instead.");
+    }
+
     QString id() const override
     { PYBIND11_OVERRIDE_PURE(QString, Item, id); }
 
@@ -302,8 +328,81 @@ public:
 };
 
 
+///
+/// Native copy of the display fields of an Item subclass.
+///
+/// The frontend reads the fields on every repaint, which takes the GIL for Item subclasses.
+/// Snapshots read them once. The Python object is kept for the actions. The icon is handed out
+/// once, further requests are forwarded.
+///
+class ItemSnapshot : public Item
+{
+public:
+
+    /// Snapshot Item subclasses crossing into the core. Opt-in, fields are not updated anymore.
+    inline static atomic_bool enabled = false;
+
+    /// Reads the fields of _item_. Requires the GIL. Throws on errors.
+    explicit ItemSnapshot(shared_ptr<Item> item):
+        id_(item->id()),
+        text_(item->text()),
+        subtext_(item->subtext()),
+        input_action_text_(item->inputActionText()),
+        icon_(item->icon()),
+        item_(::move(item))
+    {}
+
+    /// Returns a snapshot of _item_ if enabled and _item_ is an Item subclass. Requires the GIL.
+    static shared_ptr<Item> of(const shared_ptr<Item> &item)
+    {
+        if (enabled.load(memory_order_relaxed) && dynamic_cast<PyItemTrampoline*>(item.get()))
+            try {
+                return make_shared<ItemSnapshot>(item);
+            } catch (const exception &e) {
+                DEBG << "Failed taking item snapshot:" << e.what();
+            }
+        return item;
+    }
+
+    /// Replaces the Item subclasses in _items_ by snapshots if enabled. Requires the GIL.
+    template<class T>
+    static void apply(vector<T> &items)
+    {
+        if (enabled.load(memory_order_relaxed))
+            for (auto &item : items)
+                if constexpr (is_same_v<T, shared_ptr<Item>>)
+                    item = of(item);
+                else  // RankItem, IndexItem
+                    item.item = of(item.item);
+    }
+
+    QString id() const override { return id_; }
+
+    QString text() const override { return text_; }
+
+    QString subtext() const override { return subtext_; }
+
+    QString inputActionText() const override { return input_action_text_; }
+
+    // Icons are native, cloning them does not touch Python
+    unique_ptr<Icon> icon() const override { return icon_ ? icon_->clone() : nullptr; }
+
+    vector<Action> actions() const override { return item_->actions(); }
+
+private:
+
+    const QString id_;
+    const QString text_;
+    const QString subtext_;
+    const QString input_action_text_;
+    const unique_ptr<Icon> icon_;
+    const shared_ptr<Item> item_;
+
+};
+
+
 template <class Base = Extension>
-class PyExtension : public Base
+class PyExtension : public Base, public InterpreterAffinity
 {
 public:
     WORKAROUND_PYBIND_5405(id)
@@ -336,14 +435,20 @@ class PyQueryHandler : public PyExtension<Base>
 {
 public:
     QString synopsis(const QString &query) const override
-    { PYBIND11_OVERRIDE(QString, Base, synopsis, query); }
+    {
+        InterpreterGil gil(this->interpreter);
+        PYBIND11_OVERRIDE(QString, Base, synopsis, query);
+    }
 
     bool allowTriggerRemap() const override
-    { PYBIND11_OVERRIDE(bool, Base, allowTriggerRemap, ); }
+    {
+        InterpreterGil gil(this->interpreter);
+        PYBIND11_OVERRIDE(bool, Base, allowTriggerRemap, );
+    }
 
     QString defaultTrigger() const override
     {
-        py::gil_scoped_acquire gil;
+        InterpreterGil gil(this->interpreter);
         if (auto override = py::get_override(static_cast<const Base *>(this), "defaultTrigger");
             override)
             return override().template cast<QString>();  // may throw, is okay
@@ -352,13 +457,22 @@ public:
     }
 
     void setTrigger(const QString &trigger) override
-    { PYBIND11_OVERRIDE(void, Base, setTrigger, trigger); }
+    {
+        InterpreterGil gil(this->interpreter);
+        PYBIND11_OVERRIDE(void, Base, setTrigger, trigger);
+    }
 
     bool supportsFuzzyMatching() const override
-    { PYBIND11_OVERRIDE(bool, Base, supportsFuzzyMatching, ); }
+    {
+        InterpreterGil gil(this->interpreter);
+        PYBIND11_OVERRIDE(bool, Base, supportsFuzzyMatching, );
+    }
 
     void setFuzzyMatching(bool enabled) override
-    { PYBIND11_OVERRIDE(void, Base, setFuzzyMatching, enabled); }
+    {
+        InterpreterGil gil(this->interpreter);
+        PYBIND11_OVERRIDE(void, Base, setFuzzyMatching, enabled);
+    }
 
     // unique_ptr<QueryExecution> execution(QueryContext &context) override
     // { PYBIND11_OVERRIDE_PURE(unique_ptr<QueryExecution>, Base, execution, &context); }
@@ -368,55 +482,273 @@ public:
 // This class makes sure that the GIL is locked when the coroutine frame is unwound
 class ItemGeneratorWrapper
 {
+    using Clock = chrono::steady_clock;
+
+    enum class Kind { Generator, AsyncGenerator, Coroutine };
+
+    PyInterpreterState *interpreter;
+    QueryContext &context;
+    optional<QueryScope> scope;
+    Kind kind = Kind::Generator;
+    py::object gen;
     py::function fn_next;
+    exception_ptr pending_error;
+    bool exhausted = false;
+    bool merging = true;
+    uint gil_acquisitions = 0;
+    uint pulls = 0;
+    uint batches = 0;
+    size_t item_count = 0;
+
+    struct Totals
+    {
+        atomic<qint64> generators{0};
+        atomic<qint64> unmerged{0};
+        atomic<qint64> gil_acquisitions{0};
+        atomic<qint64> pulls{0};
+        atomic<qint64> batches{0};
+        atomic<qint64> items{0};
+    };
+
+    static Totals &totals()
+    {
+        static Totals totals;
+        return totals;
+    }
+
+    // Awaits the next batch on the asyncio event loop. The GIL is released while awaiting, hence
+    // there is no batch merging.
+    optional<vector<shared_ptr<Item>>> nextAsync()
+    {
+        optional<vector<shared_ptr<Item>>> items;
+        InterpreterGil acquire(interpreter);
+        ++gil_acquisitions;
+        ++pulls;
+        try {
+            // A coroutine returns a single batch
+            auto awaitable = kind == Kind::Coroutine ? exchange(gen, py::object()) : fn_next();
+            exhausted = kind == Kind::Coroutine;
+
+            if (auto batch = AsyncioLoop::run(awaitable, [this]{ return !context.isValid(); });
+                batch)
+            {
+                items = batch->cast<vector<shared_ptr<Item>>>();
+                ++batches;
+                ItemSnapshot::apply(*items);
+                item_count += items->size();
+            }
+            else  // Cancelled, the CancelledError ends the async generator
+                exhausted = true;
+        } catch (const py::error_already_set &e) {
+            if (e.matches(PyExc_StopAsyncIteration))  // Expected end
+                exhausted = true;
+            else
+                throw;
+        }
+        return items;
+    }
 
 public:
-    ItemGeneratorWrapper(py::function override, QueryContext &ctx)
+
+    /// Time budget for draining further batches of the Python generator in a single GIL hold.
+    /// The drained batches are merged. Zero, the default, pulls one batch per GIL hold.
+    /// Generators taking longer than the budget for a single batch are not merged any further.
+    inline static atomic_int pull_budget_ms = 0;
+
+    /// Maximum number of items to merge into a single batch.
+    static const size_t MAX_PULL_ITEMS = 500;
+
+    /// Time the finally blocks of an async generator get to run on close.
+    static constexpr chrono::milliseconds ACLOSE_TIMEOUT{1000};
+
+    ItemGeneratorWrapper(PyInterpreterState *interp, py::function override, QueryContext &ctx):
+        interpreter(interp),
+        context(ctx)
     {
-        py::gil_scoped_acquire acquire;
+        GcPolicy::recordActivity();
 
-        // Make sure to release the function object, before releasing the GIL
-        py::function fn_items = ::move(override);
+        {
+            InterpreterGil acquire(interpreter);
+            ++gil_acquisitions;
 
-        auto gen = fn_items(&ctx); // may throw
+            // Make sure to release the function object, before releasing the GIL
+            py::function fn_items = ::move(override);
 
-        if (!gen)
-            throw runtime_error("Failed creating generator from \"items\" override.");
+            scope.emplace(ctx);
+            try {
+                gen = fn_items(&ctx); // may throw
 
-        if (!py::hasattr(gen, "__next__"))
-            throw runtime_error("Generator object has no attr \"__next__\".");
+                if (!gen)
+                    throw runtime_error("Failed creating generator from \"items\" override.");
 
-        fn_next = gen.attr("__next__");
+                if (py::hasattr(gen, "__next__"))
+                    fn_next = gen.attr("__next__");
+                else if (py::hasattr(gen, "__anext__"))
+                {
+                    kind = Kind::AsyncGenerator;
+                    fn_next = gen.attr("__anext__");
+                }
+                else if (py::hasattr(gen, "__await__"))
+                    kind = Kind::Coroutine;
+                else
+                    throw runtime_error("Generator object has no attr \"__next__\".");
+            } catch (...) {
+                scope.reset();  // Requires the GIL
+                gen = {};
+                throw;
+            }
+            scope->leave();
+        }
     }
 
     ~ItemGeneratorWrapper()
     {
-        py::gil_scoped_acquire acquire;
-        fn_next = {};
+        InterpreterGil acquire(interpreter, nothrow);
+        if (acquire.isAcquired())
+        {
+            scope.reset();
+            fn_next = {};
+            gen = {};
+        }
+        else  // Outlived its interpreter
+        {
+            if (scope)
+                scope->abandon();
+            fn_next.release();
+            gen.release();
+        }
+
+        auto &s = totals();
+        ++s.generators;
+        s.gil_acquisitions += gil_acquisitions + 1;
+        s.pulls += pulls;
+        s.batches += batches;
+        s.items += item_count;
+        if (!merging)
+            ++s.unmerged;
     }
 
     optional<vector<shared_ptr<Item>>> next()
     {
-        py::gil_scoped_acquire acquire;
+        if (pending_error)
+            rethrow_exception(exchange(pending_error, nullptr));
+        else if (exhausted)
+            return nullopt;
+        else if (!context.isValid())
+        {
+            close();
+            return nullopt;
+        }
+        else if (kind != Kind::Generator)
+            return nextAsync();
+
+        optional<vector<shared_ptr<Item>>> items;
+        {
+            InterpreterGil acquire(interpreter);
+            ++gil_acquisitions;
+            ++pulls;
+            const auto budget = chrono::milliseconds(pull_budget_ms.load());
+            const auto deadline = Clock::now() + budget;
+            scope->enter();
+            try {
+                do {
+                    const auto pull_begin = Clock::now();
+                    auto batch = fn_next().cast<vector<shared_ptr<Item>>>();
+                    ++batches;
+
+                    // A generator blocking in __next__ would hold back the merged items
+                    if (budget.count() > 0 && Clock::now() - pull_begin > budget)
+                        merging = false;
+
+                    if (!items)
+                        items = ::move(batch);
+                    else
+                        items->insert(items->end(),
+                                      make_move_iterator(batch.begin()),
+                                      make_move_iterator(batch.end()));
+                } while (merging && items->size() < MAX_PULL_ITEMS && Clock::now() < deadline
+                         && context.isValid());
+                scope->leave();
+            } catch (const py::error_already_set &e) {
+                scope->leave();
+                if (e.matches(PyExc_StopIteration))  // Expected end
+                    exhausted = true;
+                else if (e.matches(PyExc_GeneratorExit))  // Interrupted after cancellation
+                {
+                    DEBG << "Python generator interrupted:" << context.handler().id();
+                    exhausted = true;
+                }
+                else if (items)
+                    pending_error = current_exception();  // Deliver the merged batches first
+                else
+                    throw;
+            } catch (const exception &e) {
+                scope->leave();
+                CRIT << e.what();
+                if (items)
+                    pending_error = current_exception();
+                else
+                    throw;
+            }
+
+            if (items)
+            {
+                ItemSnapshot::apply(*items);
+                item_count += items->size();
+            }
+        }
+        return items;
+    }
+
+    /// Closes the Python generator, i.e. raises GeneratorExit at its suspension point such that
+    /// its finally blocks and context managers run.
+    void close()
+    {
+        exhausted = true;
+        InterpreterGil acquire(interpreter);
+        ++gil_acquisitions;
         try {
-            return fn_next().cast<vector<shared_ptr<Item>>>();
+            if (!gen)  // Consumed coroutine
+                return;
+            else if (kind == Kind::AsyncGenerator)
+            {
+                // Cancels the close, i.e. raises CancelledError in the generator, on timeout
+                const auto deadline = Clock::now() + ACLOSE_TIMEOUT;
+                if (!AsyncioLoop::run(gen.attr("aclose")(),
+                                      [deadline]{ return Clock::now() >= deadline; }))
+                    WARN << "Closing Python async generator timed out. Abandoned it.";
+            }
+            else if (py::hasattr(gen, "close"))  // Plain iterators can not be closed
+                gen.attr("close")();
         } catch (const py::error_already_set &e) {
-            if (e.matches(PyExc_StopIteration))
-                return nullopt;  // Expected end
-            else
-                throw;
-        } catch (const exception &e) {
-            CRIT << e.what();
-            throw;
-        } catch (...) {
-            throw;
+            WARN << "Closing Python generator failed:" << e.what();
         }
-        return nullopt;
     }
 
-    static ItemGenerator generator(py::function fn_items, QueryContext &ctx)
+    /// Returns the number of GIL acquisitions of this generator so far.
+    uint gilAcquisitions() const { return gil_acquisitions; }
+
+    /// Returns the number of batches pulled from the Python generator so far.
+    uint batchCount() const { return batches; }
+
+    /// Returns the accumulated counters of all destroyed generators for debugging. Thread-safe.
+    static QJsonObject stats()
     {
-        ItemGeneratorWrapper generator(::move(fn_items), ctx);
+        const auto &s = totals();
+        return {
+            {u"generators"_s, s.generators.load()},
+            {u"unmerged_generators"_s, s.unmerged.load()},
+            {u"gil_acquisitions"_s, s.gil_acquisitions.load()},
+            {u"pulls"_s, s.pulls.load()},
+            {u"batches"_s, s.batches.load()},
+            {u"items"_s, s.items.load()}
+        };
+    }
+
+    static ItemGenerator generator(PyInterpreterState *interpreter, py::function fn_items,
+                                   QueryContext &ctx)
+    {
+        ItemGeneratorWrapper generator(interpreter, ::move(fn_items), ctx);
         while (auto next = generator.next())
             co_yield ::move(*next);
     }
@@ -425,7 +757,7 @@ public:
 template<typename T>
 py::function getOverrideLocked(const T *this_ptr, const char *name)
 {
-    py::gil_scoped_acquire acquire;
+    InterpreterGil acquire(this_ptr->interpreter);
     return py::get_override(this_ptr, name);
 }
 
@@ -438,10 +770,11 @@ public:
     // No type mismatch workaround required since base class is not called.
     ItemGenerator items(QueryContext &context) override
     {
+        LoadScheduler::recordUse(this);
         auto fn_items_override = getOverrideLocked(this, "items");
         if (fn_items_override)
             // ! This move releases the py object, such that GIL is not required on destruction
-            return ItemGeneratorWrapper::generator(::move(fn_items_override), context);
+            return ItemGeneratorWrapper::generator(this->interpreter, ::move(fn_items_override), context);
         else
             throw runtime_error("Pure virtual function \"items\"");
     }
@@ -470,7 +803,15 @@ class PyRankedQueryHandler : public PyGeneratorQueryHandler<Base>
 public:
     // No type mismatch workaround required since base class is not called.
     vector<RankItem> rankItems(QueryContext &context) override
-    { PYBIND11_OVERRIDE_PURE(vector<RankItem>, Base, rankItems, &context); }
+    {
+        GcPolicy::recordActivity();
+        InterpreterGil gil(this->interpreter);
+        QueryScope scope(context);
+        auto rank_items = [&] -> vector<RankItem>
+        { PYBIND11_OVERRIDE_PURE(vector<RankItem>, Base, rankItems, &context); }();
+        ItemSnapshot::apply(rank_items);
+        return rank_items;
+    }
 
     //
     // This is required due to the "final" quirks of the pybind trampoline chain
@@ -482,10 +823,11 @@ public:
     //
     ItemGenerator items(QueryContext &context) override
     {
+        LoadScheduler::recordUse(this);
         auto fn_items_override = getOverrideLocked(this, "items");
         if (fn_items_override)
             // ! This move releases the py object, such that GIL is not required on destruction
-            return ItemGeneratorWrapper::generator(::move(fn_items_override), context);
+            return ItemGeneratorWrapper::generator(this->interpreter, ::move(fn_items_override), context);
         else
             return Base::items(context);
     }
@@ -505,17 +847,26 @@ class PyGlobalQueryHandler : public PyRankedQueryHandler<Base>
     //
     ItemGenerator items(QueryContext &context) override
     {
+        LoadScheduler::recordUse(this);
         auto fn_items_override = getOverrideLocked(this, "items");
         if (fn_items_override)
             // ! This move releases the py object, such that GIL is not required on destruction
-            return ItemGeneratorWrapper::generator(::move(fn_items_override), context);
+            return ItemGeneratorWrapper::generator(this->interpreter, ::move(fn_items_override), context);
         else
             return Base::items(context);
     }
 
     // No type mismatch workaround required since base class is not called.
     vector<RankItem> rankItems(QueryContext &context) override
-    { PYBIND11_OVERRIDE_PURE(vector<RankItem>, Base, rankItems, &context); }
+    {
+        GcPolicy::recordActivity();
+        InterpreterGil gil(this->interpreter);
+        QueryScope scope(context);
+        auto rank_items = [&] -> vector<RankItem>
+        { PYBIND11_OVERRIDE_PURE(vector<RankItem>, Base, rankItems, &context); }();
+        ItemSnapshot::apply(rank_items);
+        return rank_items;
+    }
 
 };
 
@@ -525,7 +876,10 @@ class PyIndexQueryHandler : public PyGlobalQueryHandler<Base>
 {
 public:
     void updateIndexItems() override
-    { PYBIND11_OVERRIDE_PURE(void, Base, updateIndexItems); }
+    {
+        InterpreterGil gil(this->interpreter);
+        PYBIND11_OVERRIDE_PURE(void, Base, updateIndexItems);
+    }
 
     //
     // This is required due to the "final" quirks of the pybind trampoline chain
@@ -537,10 +891,11 @@ public:
     //
     ItemGenerator items(QueryContext &context) override
     {
+        LoadScheduler::recordUse(this);
         auto fn_items_override = getOverrideLocked(this, "items");
         if (fn_items_override)
             // ! This move releases the py object, such that GIL is not required on destruction
-            return ItemGeneratorWrapper::generator(::move(fn_items_override), context);
+            return ItemGeneratorWrapper::generator(this->interpreter, ::move(fn_items_override), context);
         else
             return Base::items(context);
     }
@@ -557,8 +912,19 @@ public:
     {
         // PyBind does not suport passing reference, but instead tries to copy.
         // Workaround by converting to pointer.
-        // This is needed because PYBIND11_OVERRIDE_PURE would introduce type mismatch.
-        PYBIND11_OVERRIDE_IMPL(vector<RankItem>, Base, "rankItems", &context);  // returns on success
+        // Index items are snapshot in setIndexItems already.
+        GcPolicy::recordActivity();
+        {
+            InterpreterGil gil(this->interpreter);
+            if (auto override = py::get_override(static_cast<const Base *>(this), "rankItems");
+                override)
+            {
+                QueryScope scope(context);
+                auto rank_items = override(&context).template cast<vector<RankItem>>();
+                ItemSnapshot::apply(rank_items);
+                return rank_items;
+            }
+        }
         return Base::rankItems(context);  // otherwise call base class
     }
 };
@@ -569,5 +935,11 @@ class PyFallbackHandler : public PyExtension<Base>
 {
 public:
     vector<shared_ptr<Item>> fallbacks(const QString &query) const override
-    { PYBIND11_OVERRIDE_PURE(vector<shared_ptr<Item>>, FallbackHandler, fallbacks, query); }
+    {
+        InterpreterGil gil(this->interpreter);
+        auto items = [&] -> vector<shared_ptr<Item>>
+        { PYBIND11_OVERRIDE_PURE(vector<shared_ptr<Item>>, FallbackHandler, fallbacks, query); }();
+        ItemSnapshot::apply(items);
+        return items;
+    }
 };
@@ -4,8 +4,12 @@
 #include <pybind11/native_enum.h>
 #include <pybind11/stl.h>
 #include "cast_specialization.hpp"  // Has to be imported first
+#include "asyncioloop.h"
+#include "metadatacache.h"
+#include "metadataparser.h"
 #include "queryexecution.h"
 #include "queryresults.h"
+#include "requirements.h"
 #include "trampolineclasses.hpp"
 
 #include "albert/fallbackhandler.h"
@@ -22,10 +26,14 @@
 #include "albert/systemutil.h"
 #include "albert/usagescoring.h"
 #include "test.h"
+#include <QRegularExpression>
 #include <QStandardPaths>
+#include <QTemporaryDir>
 #include <QTest>
 #include <QTimer>
 #include <albert/indexqueryhandler.h>
+#include <list>
+#include <thread>
 using namespace albert;
 using namespace std;
 using namespace py::literals;
@@ -47,7 +55,7 @@ struct MockQueryContext : public QueryContext
     QueryHandler *handler_;
     QString trigger_;
     QString query_;
-    bool is_valid_;
+    atomic_bool is_valid_;  // Polled by the cancellation monitor
     UsageScoring usage_scoring_;
 
     const QueryHandler &handler() const override { return *handler_; }
@@ -125,6 +133,7 @@ py::object py_make_test_icon;
 py::object py_make_test_standard_item;
 
 static auto test_initialization = R"(
+import sys
 from albert import *
 
 
@@ -161,6 +170,12 @@ def make_test_standard_item(number:int):
         actions=[make_test_action()] * number,
         input_action_text="input_action_text_" + str(number)
     )
+
+
+def query_access_allocations(context):
+    before = sys.getallocatedblocks()
+    queries = [context.query for _ in range(1000)]
+    return sys.getallocatedblocks() - before
 )";
 
 // Item has to be tested a lot while being passed around. Make it a oneliner.
@@ -208,6 +223,325 @@ void PythonTests::initTestCase()
     py_make_test_standard_item = py::globals()["make_test_standard_item"];
 }
 
+void PythonTests::testMetadataParser()
+{
+    auto assignments = parseMetadataAssignments(R"(
+"""
+md_iid = "ignored"
+"""
+md_iid = '5.0'
+md_version = "1.0"  # comment
+md_name = 'Name' " concatenated"
+md_authors = ["@a",
+              '@b\u00e4',  # comment
+              r'\d',
+]
+md_platforms = []
+
+class Plugin(PluginInstance):
+    md_name = "ignored"
+)");
+
+    QVERIFY(assignments.has_value());
+    QCOMPARE(assignments->size(), 5);
+    QCOMPARE(get<QString>(assignments->at("md_iid")), "5.0");
+    QCOMPARE(get<QString>(assignments->at("md_version")), "1.0");
+    QCOMPARE(get<QString>(assignments->at("md_name")), "Name concatenated");
+    QCOMPARE(get<QStringList>(assignments->at("md_authors")),
+             QStringList({"@a", "@b\u00e4", "\\d"}));
+    QCOMPARE(get<QStringList>(assignments->at("md_platforms")), QStringList());
+
+    // Constructs requiring a full parse
+    QVERIFY(!parseMetadataAssignments("md_iid: str = '5.0'\n"));
+    QVERIFY(!parseMetadataAssignments("md_iid = f'{x}'\n"));
+    QVERIFY(!parseMetadataAssignments("x = md_iid = '5.0'\n"));
+    QVERIFY(!parseMetadataAssignments("md_iid = '5.0'; x = 1\n"));
+    QVERIFY(!parseMetadataAssignments("md_authors = ('@a',)\n"));
+
+    // Encodings (PEP 263)
+    QVERIFY(parseMetadataAssignments("# -*- coding: utf-8 -*-\nmd_iid = '5.0'\n"));
+    QVERIFY(parseMetadataAssignments("#!/usr/bin/env python\n# coding=UTF_8\nmd_iid = '5.0'\n"));
+    QVERIFY(!parseMetadataAssignments("# -*- coding: latin-1 -*-\nmd_name = '\xe4'\n"));
+    QVERIFY(!parseMetadataAssignments("#!/usr/bin/env python\n# vim: fileencoding=cp1252\n"));
+    QVERIFY(!parseMetadataAssignments("md_name = '\xe4'\n"));  // Invalid UTF-8
+    QVERIFY(parseMetadataAssignments("x = 1\n# coding: latin-1\n"));  // Not a declaration
+}
+
+void PythonTests::testRequirements()
+{
+    QCOMPARE(normalizedDistributionName("Foo_Bar.baz>=1.0"), "foo-bar-baz");
+
+    const map<QString, QString> distributions{{"foo", "1.0"}, {"bar", "2.4.1"}, {"pre", "2.0rc1"}};
+    auto satisfied = [&](const QString &requirement) {
+        return isRequirementSatisfied(requirement, distributions);
+    };
+
+    QVERIFY(satisfied("foo") == true);
+    QVERIFY(satisfied("Foo") == true);
+    QVERIFY(satisfied("missing") == false);
+    QVERIFY(satisfied("missing>=1") == false);
+
+    QVERIFY(satisfied("foo>=1") == true);
+    QVERIFY(satisfied("foo>=2") == false);
+    QVERIFY(satisfied("foo==1.0.0") == true);
+    QVERIFY(satisfied("foo!=1") == false);
+    QVERIFY(satisfied("foo<1.0.1") == true);
+    QVERIFY(satisfied("foo>1.0") == false);
+    QVERIFY(satisfied("bar>=2,<3") == true);
+    QVERIFY(satisfied("bar >= 2, != 2.4.1") == false);
+    QVERIFY(satisfied("bar (>=2.4)") == true);
+    QVERIFY(satisfied("bar==2.4.*") == true);
+    QVERIFY(satisfied("bar!=2.*") == false);
+    QVERIFY(satisfied("bar~=2.3") == true);
+    QVERIFY(satisfied("bar~=2.3.0") == false);
+
+    // Left to pip
+    QVERIFY(satisfied("foo[extra]") == nullopt);
+    QVERIFY(satisfied("foo; sys_platform == 'linux'") == nullopt);
+    QVERIFY(satisfied("foo @ https://example.org/foo.whl") == nullopt);
+    QVERIFY(satisfied("foo>=1.0rc1") == nullopt);
+    QVERIFY(satisfied("foo>=1.*") == nullopt);
+    QVERIFY(satisfied("foo~=1") == nullopt);
+    QVERIFY(satisfied("pre>=1") == nullopt);
+}
+
+void PythonTests::testMetadataCache()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto source_path = dir.filePath("plugin.py");
+    const auto cache_path = dir.filePath("cache.json").toStdString();
+
+    // Writes the source keeping the modification time
+    auto write = [&](const QByteArray &source, const QDateTime &mtime) {
+        QFile file(source_path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(source);
+        QVERIFY(file.setFileTime(mtime, QFileDevice::FileModificationTime));
+    };
+
+    int extractions = 0;
+    auto extract = [&](const QByteArray &source) {
+        ++extractions;
+        PyPluginMetadata metadata;
+        metadata.name = QString::fromUtf8(source);
+        return metadata;
+    };
+
+    // Modified within the mtime granularity of the file system, same size
+    const auto now = QDateTime::currentDateTime();
+    write("md_a", now);
+    {
+        MetadataCache cache(cache_path);
+        QCOMPARE(cache.metadata(source_path, extract).name, "md_a");
+        QCOMPARE(extractions, 1);
+        write("md_b", now);
+        QCOMPARE(cache.metadata(source_path, extract).name, "md_b");
+        QCOMPARE(extractions, 2);
+    }
+
+    // Stats of old files are trusted, also after a restart
+    const auto past = now.addSecs(-3600);
+    write("md_c", past);
+    {
+        MetadataCache cache(cache_path);
+        QCOMPARE(cache.metadata(source_path, extract).name, "md_c");
+        QCOMPARE(extractions, 3);
+        QCOMPARE(cache.metadata(source_path, extract).name, "md_c");
+        QCOMPARE(extractions, 3);
+        QCOMPARE(cache.hits(), 1);
+        QCOMPARE(cache.misses(), 1);
+        cache.save();
+    }
+    {
+        MetadataCache cache(cache_path);
+        QCOMPARE(cache.metadata(source_path, extract).name, "md_c");
+        QCOMPARE(extractions, 3);
+        QCOMPARE(cache.hits(), 1);
+    }
+
+    // Touched but unchanged content
+    write("md_c", now);
+    {
+        MetadataCache cache(cache_path);
+        QCOMPARE(cache.metadata(source_path, extract).name, "md_c");
+        QCOMPARE(extractions, 3);
+    }
+}
+
+void PythonTests::testFreeThreading()
+{
+#ifdef Py_GIL_DISABLED
+    // Importing the module must not enable the GIL
+    QVERIFY(!py::module::import("sys").attr("_is_gil_enabled")().cast<bool>());
+#endif
+
+    py::exec(R"(
+import threading
+free_threading_lock = threading.Lock()
+free_threading_counter = 0
+
+def free_threading_increment():
+    global free_threading_counter
+    with free_threading_lock:
+        free_threading_counter += 1
+
+def free_threading_items(context):
+    for _ in range(10):
+        yield [make_test_standard_item(1) for _ in range(10)]
+)", py::globals());
+
+    // Concurrent handlers, each with its own query, using the bindings
+    const int thread_count = 8;
+    const int iterations = 100;
+    auto increment = py::globals()["free_threading_increment"].cast<py::function>();
+    auto items = py::globals()["free_threading_items"].cast<py::function>();
+
+    MockHandler handler;
+    vector<unique_ptr<MockQueryContext>> contexts;
+    for (int t = 0; t < thread_count; ++t)
+        contexts.emplace_back(make_unique<MockQueryContext>(&handler, "trigger",
+                                                            QStringLiteral("query %1").arg(t)));
+
+    vector<int> queries(thread_count, 0);
+    vector<int> item_counts(thread_count, 0);
+    atomic_int errors = 0;
+    {
+        py::gil_scoped_release release;
+        vector<thread> threads;
+        for (int t = 0; t < thread_count; ++t)
+            threads.emplace_back([&, t] {
+                py::gil_scoped_acquire acquire;
+                try {
+                    auto &ctx = *contexts[t];
+                    py::object py_ctx = py::cast(static_cast<QueryContext*>(&ctx));
+                    {
+                        QueryScope scope(ctx);
+                        for (int i = 0; i < iterations; ++i)
+                        {
+                            increment();
+                            if (py_ctx.attr("query").cast<QString>() == ctx.query_)
+                                ++queries[t];
+                        }
+                    }
+
+                    ItemGeneratorWrapper generator(nullptr, items, ctx);
+                    while (auto batch = generator.next())
+                        for (const auto &item : *batch)
+                            if (item->id() == "id_1")
+                                ++item_counts[t];
+                } catch (const exception &e) {
+                    ++errors;
+                    qWarning() << e.what();
+                }
+            });
+        for (auto &t : threads)
+            t.join();
+    }
+
+    QCOMPARE(errors.load(), 0);
+    QCOMPARE(py::globals()["free_threading_counter"].cast<int>(), thread_count * iterations);
+    for (int t = 0; t < thread_count; ++t)
+    {
+        QCOMPARE(queries[t], iterations);
+        QCOMPARE(item_counts[t], 100);
+    }
+}
+
+void PythonTests::testStringCasters()
+{
+    for (const QString &string : {QString(),
+                                  QStringLiteral("latin-1 \u00e4"),
+                                  QStringLiteral("ucs-2 \u20ac"),
+                                  QStringLiteral("ucs-4 \U0001F600")})
+    {
+        auto py_string = py::cast(string);
+        QCOMPARE(py::len(py_string), string.toUcs4().size());
+        QCOMPARE(py_string.cast<QString>(), string);
+        QCOMPARE(py_string.cast<u16string>(), string.toStdU16String());
+    }
+
+    QCOMPARE(py::eval("'\\U0001F600'").cast<QString>(), QStringLiteral("\U0001F600"));
+
+    // Canonical representations, str equality compares the kinds first
+    QVERIFY(py::cast(QStringLiteral("ascii")).equal(py::str("ascii")));
+    QVERIFY(py::cast(QStringLiteral("latin-1 \u00e4")).equal(py::eval("'latin-1 \\u00e4'")));
+    QVERIFY(py::cast(QStringLiteral("ucs-2 \u20ac")).equal(py::eval("'ucs-2 \\u20ac'")));
+
+    const QStringList list{"a", "\u00e4", "\U0001F600"};
+    auto py_list = py::cast(list);
+    QVERIFY(py::isinstance<py::list>(py_list));
+    QCOMPARE(py_list.cast<QStringList>(), list);
+    QCOMPARE(py::eval("('a', 'b')").cast<QStringList>(), QStringList({"a", "b"}));
+    QVERIFY_THROWS_EXCEPTION(py::cast_error, py::str("ab").cast<QStringList>());
+}
+
+void PythonTests::benchmarkStringCasters_data()
+{
+    QTest::addColumn<QString>("string");
+    QTest::addColumn<bool>("reference");
+
+    const QString latin1 = "Open the file foo.txt in the default application";
+    const QString bmp = QStringLiteral("\u00d6ffne die Datei f\u00fc\u00fc.txt \u20ac");
+    for (auto [name, string] : {pair{"latin-1", latin1}, pair{"ucs-2", bmp}})
+    {
+        QTest::addRow("%s u16string", name) << string << true;
+        QTest::addRow("%s caster", name) << string << false;
+    }
+}
+
+// Round trips using the former u16string conversion as reference
+void PythonTests::benchmarkStringCasters()
+{
+    QFETCH(QString, string);
+    QFETCH(bool, reference);
+    auto py_string = py::cast(string);
+
+    if (reference)
+        QBENCHMARK {
+            auto s = QString::fromStdU16String(py_string.cast<u16string>());
+            py::object o = py::cast(s.toStdU16String());
+        }
+    else
+        QBENCHMARK {
+            auto s = py_string.cast<QString>();
+            py::object o = py::cast(s);
+        }
+}
+
+void PythonTests::benchmarkStringListCasters_data()
+{
+    QTest::addColumn<bool>("reference");
+    QTest::newRow("std::list") << true;
+    QTest::newRow("caster") << false;
+}
+
+void PythonTests::benchmarkStringListCasters()
+{
+    QFETCH(bool, reference);
+    QStringList strings;
+    for (int i = 0; i < 100; ++i)
+        strings << QString("string_%1").arg(i);
+    auto py_strings = py::cast(strings);
+
+    if (reference)
+        QBENCHMARK {
+            auto l = py_strings.cast<std::list<u16string>>();
+            QStringList list;
+            for (const auto &s : l)
+                list << QString::fromStdU16String(s);
+            std::list<u16string> r;
+            for (const auto &s : list)
+                r.emplace_back(s.toStdU16String());
+            py::object o = py::cast(r);
+        }
+    else
+        QBENCHMARK {
+            auto list = py_strings.cast<QStringList>();
+            py::object o = py::cast(list);
+        }
+}
+
 void PythonTests::testBasicPluginInstance()
 {
     py::dict locals;
@@ -429,6 +763,71 @@ class InvalidTestItem(Item):
     QVERIFY_THROWS_EXCEPTION(runtime_error, item->actions());
 }
 
+void PythonTests::testItemSnapshot()
+{
+    py::dict locals;
+
+    py::exec(R"(
+class SnapshotTestItem(Item):
+    def __init__(self, number:int):
+        Item.__init__(self)
+        self._number = number
+
+    def id(self):
+        return "id_" + str(self._number)
+
+    def text(self):
+        return "text_" + str(self._number)
+
+    def subtext(self):
+        return "subtext_" + str(self._number)
+
+    def inputActionText(self):
+        return "input_action_text_" + str(self._number)
+
+    def icon(self):
+        return Icon.grapheme(str(self._number))
+
+    def actions(self):
+        return [make_test_action()] * self._number
+)", py::globals(), locals);
+
+    auto py_item = locals["SnapshotTestItem"](1);
+    auto item = py_item.cast<shared_ptr<Item>>();
+    auto standard_item = py_make_test_standard_item(1).cast<shared_ptr<Item>>();
+
+    // Disabled by default
+    QCOMPARE(ItemSnapshot::of(item), item);
+
+    ItemSnapshot::enabled = true;
+    auto snapshot = ItemSnapshot::of(item);
+    QVERIFY(dynamic_cast<ItemSnapshot*>(snapshot.get()) != nullptr);
+    QCOMPARE(ItemSnapshot::of(standard_item), standard_item);  // Native already
+
+    vector<RankItem> rank_items{{item, 1.}};
+    ItemSnapshot::apply(rank_items);
+    QVERIFY(dynamic_cast<ItemSnapshot*>(rank_items[0].item.get()) != nullptr);
+    ItemSnapshot::enabled = false;
+
+    // Fields are not updated anymore, actions are forwarded
+    py_item.attr("_number") = 2;
+    py_item = py::object();
+    item.reset();
+    {
+        py::gil_scoped_release release;
+        QCOMPARE(snapshot->id(), "id_1");
+        QCOMPARE(snapshot->text(), "text_1");
+        QCOMPARE(snapshot->subtext(), "subtext_1");
+        QCOMPARE(snapshot->inputActionText(), "input_action_text_1");
+
+        // Icons are cloned from the snapshot on every call
+        auto icon = snapshot->icon();
+        QVERIFY(icon != nullptr);
+        QCOMPARE(snapshot->icon()->toUrl(), icon->toUrl());
+    }
+    QCOMPARE(snapshot->actions().size(), 2);
+}
+
 void PythonTests::testStandardItem()
 {
     auto py_test_standard_item = py_make_test_standard_item(1);
@@ -496,6 +895,45 @@ void PythonTests::testStandardItem()
     QCOMPARE(actions[1].id, "test_action_id");
 }
 
+void PythonTests::testStandardItemMany()
+{
+    py::dict locals;
+    py::exec(R"(
+shared = StandardItem.many(ids=["a", "b", "c"],
+                           texts=["A", "B", "C"],
+                           icon_factory=make_test_icon,
+                           actions=[make_test_action()])
+per_item = StandardItem.many(ids=["a", "b"],
+                             subtexts=["x", "y"],
+                             icon_factory=[make_test_icon, make_test_icon],
+                             actions=[[], [make_test_action(), make_test_action()]],
+                             input_action_texts=["i", "j"])
+try:
+    StandardItem.many(ids=["a", "b"], texts=["A"])
+    length_mismatch_raised = False
+except ValueError:
+    length_mismatch_raised = True
+)", py::globals(), locals);
+
+    auto shared = locals["shared"].cast<vector<shared_ptr<Item>>>();
+    QCOMPARE(shared.size(), 3);
+    QCOMPARE(shared[1]->id(), "b");
+    QCOMPARE(shared[1]->text(), "B");
+    QCOMPARE(shared[1]->subtext(), "");
+    QVERIFY(shared[2]->icon() != nullptr);
+    QCOMPARE(shared[2]->actions().size(), 1);
+
+    auto per_item = locals["per_item"].cast<vector<shared_ptr<Item>>>();
+    QCOMPARE(per_item.size(), 2);
+    QCOMPARE(per_item[0]->text(), "");
+    QCOMPARE(per_item[1]->subtext(), "y");
+    QCOMPARE(per_item[1]->inputActionText(), "j");
+    QVERIFY(per_item[0]->actions().empty());
+    QCOMPARE(per_item[1]->actions().size(), 2);
+
+    QVERIFY(locals["length_mismatch_raised"].cast<bool>());
+}
+
 void PythonTests::testRankItem()
 {
     auto py_test_standard_item = py_make_test_standard_item(1);
@@ -646,6 +1084,43 @@ void PythonTests::testQueryContext()
     QCOMPARE(py_ctx.attr("trigger").cast<QString>(), "test_trigger");
     QCOMPARE(py_ctx.attr("query").cast<QString>(), "test_query");
     QCOMPARE(py_ctx.attr("isValid").cast<bool>(), true);
+
+    // Memoized for the duration of handler calls
+    {
+        QueryScope scope(ctx);
+        QVERIFY(py_ctx.attr("query").is(py_ctx.attr("query")));
+        QVERIFY(py_ctx.attr("trigger").is(py_ctx.attr("trigger")));
+        QVERIFY(py_ctx.attr("usageScoring").is(py_ctx.attr("usageScoring")));
+        QCOMPARE(py_ctx.attr("query").cast<QString>(), "test_query");
+
+        // Not a str per access
+        QVERIFY(py::globals()["query_access_allocations"](py_ctx).cast<int>() < 100);
+    }
+
+    QVERIFY(py::globals()["query_access_allocations"](py_ctx).cast<int>() >= 1000);
+}
+
+void PythonTests::benchmarkQueryContextAccess_data()
+{
+    QTest::addColumn<bool>("scoped");
+    QTest::newRow("converted") << false;
+    QTest::newRow("memoized") << true;
+}
+
+// Handlers accessing the context in per item loops. Allocated blocks of 1000 accesses.
+void PythonTests::benchmarkQueryContextAccess()
+{
+    QFETCH(bool, scoped);
+    auto handler = MockHandler();
+    auto ctx = MockQueryContext(&handler, "test_trigger", "some query string");
+    py::object py_ctx = py::cast(static_cast<QueryContext*>(&ctx));
+
+    optional<QueryScope> scope;
+    if (scoped)
+        scope.emplace(ctx);
+
+    const auto blocks = py::globals()["query_access_allocations"](py_ctx).cast<int>();
+    QTest::setBenchmarkResult(blocks, QTest::Events);
 }
 
 // void PythonTests::testQueryResults()
@@ -993,6 +1468,200 @@ class Handler(GeneratorQueryHandler):
     testCppItemGenerator(cpp_inst,  {{1}, {1, 2}, {1, 2, 3}});
 }
 
+void PythonTests::testItemGeneratorPulling()
+{
+    py::dict locals;
+    py::exec(R"(
+def items(context):
+    for i in range(10):
+        yield [make_test_standard_item(1)]
+)", py::globals(), locals);
+
+    MockHandler handler;
+    MockQueryContext ctx(&handler);
+    const auto budget = ItemGeneratorWrapper::pull_budget_ms.load();
+
+    // One batch per GIL acquisition
+    ItemGeneratorWrapper::pull_budget_ms = 0;
+    {
+        ItemGeneratorWrapper generator(nullptr, locals["items"].cast<py::function>(), ctx);
+        int pulls = 0;
+        while (auto batch = generator.next())
+        {
+            QCOMPARE(batch->size(), 1);
+            ++pulls;
+        }
+        QCOMPARE(pulls, 10);
+        QCOMPARE(generator.batchCount(), 10);
+        QCOMPARE(generator.gilAcquisitions(), 12);  // construction, batches, end
+    }
+
+    // Batches merged in a single GIL acquisition
+    ItemGeneratorWrapper::pull_budget_ms = 1000;
+    {
+        ItemGeneratorWrapper generator(nullptr, locals["items"].cast<py::function>(), ctx);
+        auto batch = generator.next();
+        QVERIFY(batch.has_value());
+        QCOMPARE(batch->size(), 10);
+        QVERIFY(!generator.next().has_value());
+        QCOMPARE(generator.batchCount(), 10);
+        QCOMPARE(generator.gilAcquisitions(), 2);  // construction, batches
+    }
+
+    // Generators blocking longer than the budget in __next__ are not merged any further
+    py::exec(R"(
+import time
+def slow_items(context):
+    yield [make_test_standard_item(1)]
+    time.sleep(0.05)
+    for i in range(3):
+        yield [make_test_standard_item(1)]
+)", py::globals(), locals);
+
+    const auto generators = ItemGeneratorWrapper::stats()["generators"].toInteger();
+    const auto unmerged = ItemGeneratorWrapper::stats()["unmerged_generators"].toInteger();
+    ItemGeneratorWrapper::pull_budget_ms = 10;
+    {
+        ItemGeneratorWrapper generator(nullptr, locals["slow_items"].cast<py::function>(), ctx);
+        QCOMPARE(generator.next()->size(), 2);  // The blocking pull ends the merge
+        QCOMPARE(generator.next()->size(), 1);
+        QCOMPARE(generator.next()->size(), 1);
+        QVERIFY(!generator.next().has_value());
+    }
+    QCOMPARE(ItemGeneratorWrapper::stats()["generators"].toInteger(), generators + 1);
+    QCOMPARE(ItemGeneratorWrapper::stats()["unmerged_generators"].toInteger(), unmerged + 1);
+
+    ItemGeneratorWrapper::pull_budget_ms = budget;
+}
+
+void PythonTests::testQueryCancellation()
+{
+    py::exec(R"(
+cancellation_test_event = None
+cancellation_test_closed = False
+def cancellation_test_items(context):
+    global cancellation_test_event, cancellation_test_closed
+    cancellation_test_event = context.cancellation
+    try:
+        while True:
+            yield [make_test_standard_item(1)]
+    finally:
+        cancellation_test_closed = True
+)", py::globals());
+
+    MockHandler handler;
+    MockQueryContext ctx(&handler);
+    const auto budget = ItemGeneratorWrapper::pull_budget_ms.load();
+    ItemGeneratorWrapper::pull_budget_ms = 0;
+
+    {
+        ItemGeneratorWrapper generator(nullptr,
+                                       py::globals()["cancellation_test_items"].cast<py::function>(),
+                                       ctx);
+        QVERIFY(generator.next().has_value());
+
+        py::object event = py::globals()["cancellation_test_event"];
+        QVERIFY(!event.attr("is_set")().cast<bool>());
+
+        // The monitor sets the event
+        ctx.is_valid_ = false;
+        {
+            py::gil_scoped_release release;
+            for (int i = 0; i < 100; ++i)
+            {
+                {
+                    py::gil_scoped_acquire acquire;
+                    if (event.attr("is_set")().cast<bool>())
+                        break;
+                }
+                this_thread::sleep_for(10ms);
+            }
+        }
+        QVERIFY(event.attr("is_set")().cast<bool>());
+
+        // The generator is closed
+        QVERIFY(!generator.next().has_value());
+        QVERIFY(py::globals()["cancellation_test_closed"].cast<bool>());
+    }
+
+    // Plain iterators have no close()
+    QTest::failOnWarning(QRegularExpression(QStringLiteral("Closing Python generator failed")));
+    {
+        auto items = py::eval("lambda context: iter([[make_test_standard_item(1)]] * 3)");
+        ItemGeneratorWrapper generator(nullptr, items.cast<py::function>(), ctx);
+        QVERIFY(!generator.next().has_value());
+    }
+
+    // Outside of handler calls the event reflects the current state
+    QVERIFY(py::cast(static_cast<QueryContext*>(&ctx)).attr("cancellation")
+                .attr("is_set")().cast<bool>());
+
+    ItemGeneratorWrapper::pull_budget_ms = budget;
+}
+
+void PythonTests::testAsyncItemGenerator()
+{
+    py::exec(R"(
+import asyncio
+
+async def async_generator_items(context):
+    for i in range(3):
+        await asyncio.sleep(0.01)
+        yield [make_test_standard_item(1)]
+
+async def coroutine_items(context):
+    await asyncio.sleep(0.01)
+    return [make_test_standard_item(1), make_test_standard_item(2)]
+
+async def async_endless_items(context):
+    await asyncio.sleep(60)
+    yield []
+)", py::globals());
+
+    MockHandler handler;
+    MockQueryContext ctx(&handler);
+
+    {
+        auto fn = py::globals()["async_generator_items"].cast<py::function>();
+        ItemGeneratorWrapper generator(nullptr, fn, ctx);
+        int pulls = 0;
+        while (auto batch = generator.next())
+        {
+            QCOMPARE(batch->size(), 1);
+            ++pulls;
+        }
+        QCOMPARE(pulls, 3);
+    }
+
+    {
+        auto fn = py::globals()["coroutine_items"].cast<py::function>();
+        ItemGeneratorWrapper generator(nullptr, fn, ctx);
+        auto batch = generator.next();
+        QVERIFY(batch.has_value());
+        QCOMPARE(batch->size(), 2);
+        QVERIFY(!generator.next().has_value());
+    }
+
+    // Awaiting is cancelled with the query
+    {
+        auto fn = py::globals()["async_endless_items"].cast<py::function>();
+        ItemGeneratorWrapper generator(nullptr, fn, ctx);
+        thread invalidate([&ctx] {
+            this_thread::sleep_for(50ms);
+            ctx.is_valid_ = false;
+        });
+        const auto begin = chrono::steady_clock::now();
+        const auto batch = generator.next();
+        const auto elapsed = chrono::steady_clock::now() - begin;
+        invalidate.join();
+        QVERIFY(!batch.has_value());
+        QVERIFY(elapsed < 5s);
+    }
+
+    py::gil_scoped_release release;
+    AsyncioLoop::stop();
+}
+
 void PythonTests::testRankedQueryHandler()
 {
     auto [py_inst, cpp_inst] = makeTestClass<RankedQueryHandler>(R"(
@@ -9,23 +9,40 @@ private slots:
 
     void initTestCase();
 
+    void testMetadataParser();
+    void testRequirements();
+    void testMetadataCache();
+    void testStringCasters();
+    void benchmarkStringCasters_data();
+    void benchmarkStringCasters();
+    void benchmarkStringListCasters_data();
+    void benchmarkStringListCasters();
+    void testFreeThreading();
+
     void testBasicPluginInstance();
     void testExtensionPluginInstance();
 
     void testAction();
     void testItem();
+    void testItemSnapshot();
     void testStandardItem();
+    void testStandardItemMany();
     void testRankItem();
     void testIndexItem();
     void testMatcher();
     void testIconFactories();
 
     void testQueryContext();
+    void benchmarkQueryContextAccess_data();
+    void benchmarkQueryContextAccess();
     // void testQueryResults();
     // void testQueryExecution();
 
     // void testQueryHandler();
     void testGeneratorQueryHandler();
+    void testItemGeneratorPulling();
+    void testQueryCancellation();
+    void testAsyncItemGenerator();
     void testRankedQueryHandler();
     void testGlobalQueryHandler();
     void testIndexQueryHandler();